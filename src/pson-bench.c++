@@ -0,0 +1,1019 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <pson/canonical.h++>
+#include <pson/columnar.h++>
+#include <pson/compression.h++>
+#include <pson/document_cache.h++>
+#include <pson/emitter.h++>
+#include <pson/lexer.h++>
+#include <pson/memory.h++>
+#include <pson/merge.h++>
+#include <pson/mutable_document.h++>
+#include <pson/parallel.h++>
+#include <pson/parser.h++>
+#include <pson/push_parser.h++>
+#include <pson/record_file.h++>
+#include <pson/transcoder.h++>
+#include <pson/validate.h++>
+#include <pson/shared_document.h++>
+#include <pson/tree.h++>
+#include <pson/writer.h++>
+#include <tclap/CmdLine.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <thread>
+#include "version.h"
+
+/* Every allocation made by the process goes through here, which lets the
+ * benchmarks report how hard each phase leans on the heap.  The counters are
+ * striped across threads so counting doesn't itself become the bottleneck
+ * of the multi-threaded benchmarks. */
+struct alignas(64) allocation_counter {
+    std::atomic<size_t> count;
+    std::atomic<size_t> bytes;
+};
+static allocation_counter allocation_counters[64];
+static std::atomic<size_t> allocation_next_slot(0);
+static thread_local size_t allocation_slot = allocation_next_slot++ % 64;
+
+static size_t allocation_count(void);
+static size_t allocation_bytes(void);
+
+void *operator new(size_t size)
+{
+    auto& counter = allocation_counters[allocation_slot];
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+    counter.bytes.fetch_add(size, std::memory_order_relaxed);
+    auto out = malloc(size == 0 ? 1 : size);
+    if (out == nullptr)
+        throw std::bad_alloc();
+    return out;
+}
+
+/* These are kept out of line so GCC doesn't see a new/delete pair turn into
+ * a malloc/free pair and complain about the mismatch. */
+__attribute__((noinline))
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+__attribute__((noinline))
+void operator delete(void *ptr, size_t size __attribute__((unused))) noexcept
+{
+    free(ptr);
+}
+
+/* A single chunk of input that gets fed through each phase. */
+struct corpus {
+    std::string name;
+    bool pson;
+    bool ndjson;
+    std::string data;
+};
+
+/* The result of running one phase over one corpus. */
+struct result {
+    std::string corpus;
+    std::string phase;
+    size_t bytes;
+
+    /* Some phases count individual operations rather than bytes. */
+    size_t operations;
+    size_t iterations;
+    double seconds;
+    size_t allocations;
+    size_t allocated_bytes;
+    long peak_rss_kb;
+};
+
+namespace pson {
+    template<> struct serializer<result> {
+        static void write(writer& w, const result& r) {
+            w.begin_object()
+                .field("corpus", r.corpus)
+                .field("phase", r.phase)
+                .field("bytes", r.bytes)
+                .field("operations", r.operations)
+                .field("iterations", r.iterations)
+                .field("seconds", r.seconds)
+                .field("mb_per_second", r.bytes / r.seconds / 1e6)
+                .field("mops_per_second", r.operations / r.seconds / 1e6)
+                .field("allocations", r.allocations)
+                .field("allocated_bytes", r.allocated_bytes)
+                .field("peak_rss_kb", r.peak_rss_kb)
+                .end_object();
+        }
+    };
+}
+
+static std::vector<corpus> generate(size_t size, size_t depth);
+static result measure(const corpus& c,
+                      const std::string& phase,
+                      size_t bytes,
+                      size_t iterations,
+                      std::function<void(void)> func);
+static void on_threads(size_t threads, std::function<void(size_t)> func);
+static size_t walk_shared(const std::shared_ptr<pson::tree>& root);
+static size_t walk_borrowed(const pson::tree *root);
+static std::vector<std::vector<std::string>> patch_targets(const std::shared_ptr<pson::tree>& root, size_t count);
+static std::string pointer_to(const std::vector<std::string>& tokens);
+static std::shared_ptr<pson::tree> rebuild_replace(const std::shared_ptr<pson::tree>& node,
+                                                   const std::vector<std::string>& tokens,
+                                                   size_t depth,
+                                                   const std::shared_ptr<pson::tree>& value);
+static long peak_rss_kb(void);
+static void report_text(const std::vector<result>& results);
+
+int main(int argc, const char **argv)
+{
+    try {
+        TCLAP::CmdLine cmd(
+            "Benchmarks the PSON lexer, parser, and emitter\n",
+            ' ',
+            PCONFIGURE_VERSION);
+
+        TCLAP::ValueArg<size_t> size("s",
+                                     "size",
+                                     "Approximate size of each corpus, in bytes",
+                                     false,
+                                     1 << 20,
+                                     "bytes");
+        cmd.add(size);
+
+        TCLAP::ValueArg<size_t> depth("d",
+                                      "depth",
+                                      "Nesting depth of the deep corpus",
+                                      false,
+                                      256,
+                                      "levels");
+        cmd.add(depth);
+
+        TCLAP::ValueArg<size_t> iterations("n",
+                                           "iterations",
+                                           "Number of times to run each benchmark",
+                                           false,
+                                           5,
+                                           "count");
+        cmd.add(iterations);
+
+        TCLAP::ValueArg<size_t> threads("t",
+                                        "threads",
+                                        "Number of threads for the multi-threaded benchmarks",
+                                        false,
+                                        std::thread::hardware_concurrency(),
+                                        "count");
+        cmd.add(threads);
+
+        TCLAP::ValueArg<std::string> only("c",
+                                          "corpus",
+                                          "Only run benchmarks for this corpus",
+                                          false,
+                                          "",
+                                          "name");
+        cmd.add(only);
+
+        TCLAP::ValueArg<std::string> format("f",
+                                            "format",
+                                            "Output format: text or json",
+                                            false,
+                                            "text",
+                                            "format");
+        cmd.add(format);
+
+        TCLAP::ValueArg<std::string> scratch("o",
+                                             "scratch",
+                                             "Where the emitter benchmarks write their output",
+                                             false,
+                                             "/dev/null",
+                                             "out.json");
+        cmd.add(scratch);
+
+        cmd.parse(argc, argv);
+
+        if (format.getValue() != "text" && format.getValue() != "json") {
+            std::cerr << "Unknown output format " << format.getValue() << "\n";
+            return 2;
+        }
+
+        std::vector<result> results;
+        for (const auto& c: generate(size.getValue(), depth.getValue())) {
+            if (only.getValue() != "" && only.getValue() != c.name)
+                continue;
+
+            /* NDJSON files are a sequence of independent documents, one per
+             * line, which is how they get fed to the library. */
+            std::vector<std::string> documents;
+            if (c.ndjson) {
+                std::istringstream ss(c.data);
+                std::string line;
+                while (std::getline(ss, line))
+                    if (line.size() > 0)
+                        documents.push_back(line);
+            } else {
+                documents.push_back(c.data);
+            }
+
+            auto parse = [&](const std::string& d, pson::memory_resource *mr) {
+                return c.pson ? pson::parse_pson_string(d, mr) : pson::parse_json_string(d, mr);
+            };
+
+            auto bytes = c.data.size();
+            results.push_back(measure(c, "lex", bytes, iterations.getValue(), [&](){
+                for (const auto& d: documents)
+                    pson::lexer::lex_string(d);
+            }));
+
+            results.push_back(measure(c, "validate", bytes, iterations.getValue(), [&](){
+                for (const auto& d: documents)
+                    c.pson ? pson::validate_pson_string(d) : pson::validate_json_string(d);
+            }));
+
+            results.push_back(measure(c, "parse", bytes, iterations.getValue(), [&](){
+                for (const auto& d: documents)
+                    parse(d, nullptr);
+            }));
+
+            /* The same again, but with a single context that's kept warm
+             * across every document. */
+            pson::parse_context context;
+            results.push_back(measure(c, "parse_ctx", bytes, iterations.getValue(), [&](){
+                for (const auto& d: documents)
+                    c.pson ? context.parse_pson_string(d) : context.parse_json_string(d);
+            }));
+
+            /* The whole corpus fed in as if it were arriving off a socket, a
+             * few kilobytes at a time. */
+            results.push_back(measure(c, "parse_push", bytes, iterations.getValue(), [&](){
+                pson::push_parser p(!c.pson);
+                for (size_t i = 0; i < c.data.size(); i += 4096) {
+                    p.feed(c.data.data() + i, std::min<size_t>(4096, c.data.size() - i));
+                    while (p.available())
+                        p.next();
+                }
+                p.finish();
+                while (p.available())
+                    p.next();
+            }));
+
+            /* Every thread parses the whole corpus, either straight out of
+             * the global heap or out of a per-thread arena that gets
+             * recycled after each document. */
+            auto nthreads = threads.getValue() < 1 ? 1 : threads.getValue();
+            results.push_back(measure(c, "parse_mt", bytes * nthreads, iterations.getValue(), [&](){
+                on_threads(nthreads, [&](size_t i) {
+                    for (const auto& d: documents)
+                        parse(d, nullptr);
+                });
+            }));
+
+            std::vector<std::unique_ptr<pson::monotonic_buffer_resource>> arenas;
+            for (size_t i = 0; i < nthreads; ++i)
+                arenas.push_back(std::make_unique<pson::monotonic_buffer_resource>(1 << 16));
+            results.push_back(measure(c, "parse_mt_arena", bytes * nthreads, iterations.getValue(), [&](){
+                on_threads(nthreads, [&](size_t i) {
+                    for (const auto& d: documents) {
+                        parse(d, arenas[i].get());
+                        arenas[i]->release();
+                    }
+                });
+            }));
+
+            std::atomic<size_t> visited(0);
+
+            /* Whole files, either read in one go and then lexed or read in
+             * chunks on another thread while they're being lexed. */
+            if (!c.ndjson) {
+                char path[] = "/tmp/pson-bench.XXXXXX";
+                int fd = mkstemp(path);
+                if (fd < 0) {
+                    std::cerr << "Unable to create a temporary file\n";
+                    return 1;
+                }
+                close(fd);
+                std::ofstream(path, std::ios::binary) << c.data;
+
+                results.push_back(measure(c, "parse_file", bytes, iterations.getValue(), [&](){
+                    c.pson ? pson::parse_pson_file(path) : pson::parse_json_file(path);
+                }));
+
+                results.push_back(measure(c, "parse_file_async", bytes, iterations.getValue(), [&](){
+                    auto f = c.pson ? pson::parse_pson_file_async(path) : pson::parse_json_file_async(path);
+                    f.get();
+                }));
+
+                /* The same file gzipped, which is decompressed on the way
+                 * into the lexer. */
+                auto gzipped = std::string(path) + ".gz";
+                {
+                    pson::compressed_ofstream out(gzipped, pson::compression::GZIP);
+                    out << c.data;
+                }
+                results.push_back(measure(c, "parse_file_gzip", bytes, iterations.getValue(), [&](){
+                    c.pson ? pson::parse_pson_file(gzipped) : pson::parse_json_file(gzipped);
+                }));
+                unlink(gzipped.c_str());
+
+                /* Repeat loads of an unchanged file out of a cache. */
+                pson::document_cache cache;
+                results.push_back(measure(c, "parse_file_cache", bytes, iterations.getValue(), [&](){
+                    c.pson ? cache.parse_pson_file(path) : cache.parse_json_file(path);
+                }));
+
+                unlink(path);
+            } else {
+                char path[] = "/tmp/pson-bench.XXXXXX";
+                int fd = mkstemp(path);
+                if (fd < 0) {
+                    std::cerr << "Unable to create a temporary file\n";
+                    return 1;
+                }
+                close(fd);
+                std::ofstream(path, std::ios::binary) << c.data;
+
+                /* Finding where every record starts, and then parsing a
+                 * scattering of single records out of the indexed file. */
+                results.push_back(measure(c, "record_index", bytes, iterations.getValue(), [&](){
+                    pson::record_file f(path, !c.pson);
+                    visited += f.size();
+                }));
+
+                pson::record_file f(path, !c.pson);
+                const size_t lookups = 1000;
+                auto r = measure(c, "record_lookup", 0, iterations.getValue(), [&](){
+                    for (size_t i = 0; i < lookups; ++i)
+                        visited += f.parse((i * 2654435761) % f.size()) != nullptr;
+                });
+                r.operations = lookups;
+                results.push_back(r);
+
+                unlink(path);
+            }
+
+            std::vector<std::shared_ptr<pson::tree>> trees;
+            for (const auto& d: documents)
+                trees.push_back(parse(d, nullptr));
+
+            results.push_back(measure(c, "emit", bytes, iterations.getValue(), [&](){
+                for (const auto& t: trees)
+                    pson::emit_json(scratch.getValue(), t);
+            }));
+
+            /* Pulling a few fields out of every record, either one lookup at
+             * a time or all at once. */
+            std::vector<const pson::tree_object *> records;
+            for (const auto& t: trees) {
+                if (auto o = dynamic_cast<const pson::tree_object *>(t.get()))
+                    records.push_back(o);
+                if (auto a = dynamic_cast<const pson::tree_array *>(t.get()))
+                    for (size_t i = 0; i < a->size(); ++i)
+                        if (auto o = dynamic_cast<const pson::tree_object *>(a->at(i)))
+                            records.push_back(o);
+            }
+
+            if (records.size() > 0) {
+                auto r = measure(c, "decode_get", 0, iterations.getValue(), [&](){
+                    for (const auto& record: records) {
+                        auto id = record->get<int>("id");
+                        auto name = record->get<std::string>("name");
+                        auto missing = record->get_pair("missing");
+                        visited += id.valid() + name.valid() + (missing != nullptr);
+                    }
+                });
+                r.operations = records.size();
+                results.push_back(r);
+
+                r = measure(c, "decode_extract", 0, iterations.getValue(), [&](){
+                    pson::option<int> id;
+                    pson::option<std::string> name;
+                    const pson::tree_array *missing = nullptr;
+                    pson::fields f;
+                    f.add("id", id).add("name", name).add("missing", missing);
+                    for (const auto& record: records)
+                        visited += record->extract(f);
+                });
+                r.operations = records.size();
+                results.push_back(r);
+
+                /* The same two fields for every record as columns, either
+                 * from the trees or straight from the text without building
+                 * any tree at all. */
+                r = measure(c, "columns_tree", 0, iterations.getValue(), [&](){
+                    for (const auto& t: trees) {
+                        pson::columns cols;
+                        auto& id = cols.add<int>("id");
+                        cols.add<std::string>("name");
+                        pson::extract_columns(t, cols);
+                        visited += id.size() - id.invalid_count();
+                    }
+                });
+                r.operations = records.size();
+                results.push_back(r);
+
+                r = measure(c, "columns_stream", bytes, iterations.getValue(), [&](){
+                    for (const auto& d: documents) {
+                        pson::columns cols;
+                        auto& id = cols.add<int>("id");
+                        cols.add<std::string>("name");
+                        pson::column_extractor e(cols, !c.pson);
+                        for (size_t i = 0; i < d.size(); i += 1 << 16)
+                            e.feed(d.data() + i, std::min<size_t>(1 << 16, d.size() - i));
+                        e.finish();
+                        visited += id.size() - id.invalid_count();
+                    }
+                });
+                r.operations = records.size();
+                results.push_back(r);
+            }
+
+            /* Laying a small overlay over every document, which only has
+             * to build the objects along the way to what changed. */
+            {
+                auto overlay = pson::parse_pson_string("{\"key1\": {\"replaced\": 1}, \"extra\": [1, 2, 3]}");
+                auto r = measure(c, "merge", 0, iterations.getValue(), [&](){
+                    for (const auto& t: trees)
+                        visited += pson::merge(t, overlay) != t;
+                });
+                r.operations = trees.size();
+                results.push_back(r);
+            }
+
+            /* A stream of small changes to every document, each of which is
+             * then written back out: either edited in place, or with every
+             * ancestor of each change rebuilt as immutable trees need. */
+            {
+                auto per_tree = std::max<size_t>(1, 1000 / std::max<size_t>(1, trees.size()));
+                std::vector<std::vector<std::vector<std::string>>> targets;
+                std::vector<std::vector<std::string>> pointers;
+                size_t patches = 0;
+                for (const auto& t: trees) {
+                    targets.push_back(patch_targets(t, per_tree));
+                    pointers.push_back(std::vector<std::string>());
+                    for (const auto& tokens: targets.back())
+                        pointers.back().push_back(pointer_to(tokens));
+                    patches += targets.back().size();
+                }
+                auto value = std::make_shared<pson::tree_element<int>>(42);
+
+                auto r = measure(c, "patch_inplace", 0, iterations.getValue(), [&](){
+                    for (size_t i = 0; i < trees.size(); ++i) {
+                        pson::mutable_document d(trees[i]);
+                        for (const auto& pointer: pointers[i])
+                            visited += d.replace(pointer, value);
+                        pson::emit_json(scratch.getValue(), d.root());
+                    }
+                });
+                r.operations = patches;
+                results.push_back(r);
+
+                r = measure(c, "patch_rebuild", 0, iterations.getValue(), [&](){
+                    for (size_t i = 0; i < trees.size(); ++i) {
+                        auto t = trees[i];
+                        for (const auto& tokens: targets[i])
+                            t = rebuild_replace(t, tokens, 0, value);
+                        visited += t != trees[i];
+                        pson::emit_json(scratch.getValue(), t);
+                    }
+                });
+                r.operations = patches;
+                results.push_back(r);
+            }
+
+            results.push_back(measure(c, "canonical", bytes, iterations.getValue(), [&](){
+                for (const auto& t: trees)
+                    pson::canonical_json(t);
+            }));
+
+            results.push_back(measure(c, "hash", bytes, iterations.getValue(), [&](){
+                for (const auto& t: trees)
+                    pson::structural_hash(t);
+            }));
+
+            /* Straight from input text to output text, with no tree in
+             * between. */
+            results.push_back(measure(c, "transcode", bytes, iterations.getValue(), [&](){
+                std::ofstream out(scratch.getValue());
+                for (const auto& d: documents) {
+                    pson::transcoder t(out, pson::writer::format::PRETTY, !c.pson);
+                    for (size_t i = 0; i < d.size(); i += 1 << 16)
+                        t.feed(d.data() + i, std::min<size_t>(1 << 16, d.size() - i));
+                    t.finish();
+                }
+            }));
+
+            /* Every thread walks the same shared trees, either by copying
+             * std::shared_ptrs around (which bounces the reference counts
+             * between cores) or through the borrowed accessors. */
+            results.push_back(measure(c, "walk_shared", bytes * nthreads, iterations.getValue(), [&](){
+                on_threads(nthreads, [&](size_t i) {
+                    for (const auto& t: trees)
+                        visited += walk_shared(t);
+                });
+            }));
+
+            results.push_back(measure(c, "walk_borrowed", bytes * nthreads, iterations.getValue(), [&](){
+                on_threads(nthreads, [&](size_t i) {
+                    for (const auto& t: trees)
+                        visited += walk_borrowed(t.get());
+                });
+            }));
+
+            /* Something expensive done to every element of an array, one
+             * at a time and then spread across a pool with as many threads
+             * as were asked for: running with different thread counts shows
+             * how it scales. */
+            std::vector<std::shared_ptr<pson::tree_object>> holders;
+            size_t elements = 0;
+            for (const auto& t: trees) {
+                if (auto a = std::dynamic_pointer_cast<pson::tree_array>(t)) {
+                    auto key = std::make_shared<pson::tree_element<std::string>>("elements");
+                    auto pair = pson::make_tree_pair(std::shared_ptr<pson::tree>(key), t);
+                    holders.push_back(std::make_shared<pson::tree_object>(std::vector<decltype(pair)>{pair}));
+                    elements += a->size();
+                }
+            }
+
+            if (elements > 0) {
+                std::function<size_t(std::shared_ptr<pson::tree>)> expensive =
+                    [](std::shared_ptr<pson::tree> element) { return pson::canonical_json(element).size(); };
+
+                auto r = measure(c, "map", bytes, iterations.getValue(), [&](){
+                    for (const auto& h: holders)
+                        visited += h->map<size_t, pson::tree>("elements", expensive).size();
+                });
+                r.operations = elements;
+                results.push_back(r);
+
+                pson::thread_pool pool(nthreads);
+                r = measure(c, "map_parallel", bytes, iterations.getValue(), [&](){
+                    for (const auto& h: holders)
+                        visited += pson::map_parallel<size_t, pson::tree>(*h, "elements", expensive, 0, pool).size();
+                });
+                r.operations = elements;
+                results.push_back(r);
+            }
+        }
+
+        /* Lots of threads reading a small config while another thread
+         * keeps reloading it, comparing a mutex-guarded root against
+         * shared_document's snapshots and cached readers. */
+        if (only.getValue() == "" || only.getValue() == "reload") {
+            auto c = corpus{"reload", true, false, ""};
+            for (size_t i = 0; i < 32; ++i)
+                c.data += "\"key" + std::to_string(i) + "\": " + std::to_string(i) + ",\n";
+            c.data = "{\n" + c.data + "}\n";
+
+            auto nthreads = threads.getValue() < 1 ? 1 : threads.getValue();
+            size_t reads = 1 << 18;
+            auto with_reloads = [&](std::function<void(void)> reload,
+                                    std::function<size_t(size_t)> read) {
+                std::atomic<bool> done(false);
+                std::atomic<size_t> found(0);
+                std::thread writer([&](){
+                    while (!done.load()) {
+                        reload();
+                        std::this_thread::yield();
+                    }
+                });
+                on_threads(nthreads, [&](size_t i) {
+                    size_t mine = 0;
+                    for (size_t j = 0; j < reads; ++j)
+                        mine += read(i);
+                    found += mine;
+                });
+                done = true;
+                writer.join();
+            };
+
+            std::mutex lock;
+            auto guarded = pson::parse_pson_string(c.data);
+            auto r = measure(c, "reads_mutex", 0, iterations.getValue(), [&](){
+                with_reloads([&](){
+                    auto root = pson::parse_pson_string(c.data);
+                    std::unique_lock<std::mutex> l(lock);
+                    guarded = root;
+                }, [&](size_t i){
+                    std::shared_ptr<pson::tree> root;
+                    {
+                        std::unique_lock<std::mutex> l(lock);
+                        root = guarded;
+                    }
+                    auto object = dynamic_cast<const pson::tree_object *>(root.get());
+                    return object->find("key7") != nullptr;
+                });
+            });
+            r.operations = reads * nthreads;
+            results.push_back(r);
+
+            pson::shared_document document(pson::parse_pson_string(c.data));
+            auto reload = [&](){
+                document.publish(pson::parse_pson_string(c.data));
+            };
+
+            r = measure(c, "reads_snapshot", 0, iterations.getValue(), [&](){
+                with_reloads(reload, [&](size_t i){
+                    auto root = document.snapshot();
+                    auto object = dynamic_cast<const pson::tree_object *>(root.get());
+                    return object->find("key7") != nullptr;
+                });
+            });
+            r.operations = reads * nthreads;
+            results.push_back(r);
+
+            std::vector<pson::shared_document::reader> readers;
+            for (size_t i = 0; i < nthreads; ++i)
+                readers.push_back(pson::shared_document::reader(document));
+            r = measure(c, "reads_reader", 0, iterations.getValue(), [&](){
+                with_reloads(reload, [&](size_t i){
+                    auto object = dynamic_cast<const pson::tree_object *>(readers[i].get());
+                    return object->find("key7") != nullptr;
+                });
+            });
+            r.operations = reads * nthreads;
+            results.push_back(r);
+        }
+
+        if (format.getValue() == "json") {
+            pson::writer w;
+            w.write(results);
+            std::cout << w.str() << "\n";
+        } else {
+            report_text(results);
+        }
+
+        return 0;
+    } catch (TCLAP::ArgException &e) {
+        std::cerr << "error: "
+                  << e.error()
+                  << " for arg "
+                  << e.argId()
+                  << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
+
+std::vector<corpus> generate(size_t size, size_t depth)
+{
+    std::vector<corpus> out;
+
+    /* Many copies of a single deeply nested document, alternating between
+     * arrays and objects at each level. */
+    {
+        std::string one;
+        for (size_t i = 0; i < depth; ++i)
+            one += (i % 2 == 0) ? "[" : "{\"a\": ";
+        one += "1";
+        for (size_t i = depth; i > 0; --i)
+            one += ((i - 1) % 2 == 0) ? "]" : "}";
+
+        std::string data = "[";
+        do {
+            data += one;
+            if (data.size() < size)
+                data += ", ";
+        } while (data.size() < size);
+        data += "]";
+        out.push_back(corpus{"deep", false, false, data});
+    }
+
+    /* A single object with a huge number of keys. */
+    {
+        std::string data = "{";
+        for (size_t i = 0; data.size() < size; ++i) {
+            if (i > 0)
+                data += ", ";
+            data += "\"key" + std::to_string(i) + "\": " + std::to_string(i);
+        }
+        data += "}";
+        out.push_back(corpus{"wide", false, false, data});
+    }
+
+    /* An array of long strings, with the occasional escape thrown in. */
+    {
+        std::string one;
+        for (size_t i = 0; one.size() < 4096; ++i)
+            one += (i % 64 == 63) ? "\\\"" : std::string(1, 'a' + (i % 26));
+
+        std::string data = "[";
+        do {
+            data += "\"" + one + "\"";
+            if (data.size() < size)
+                data += ", ";
+        } while (data.size() < size);
+        data += "]";
+        out.push_back(corpus{"long_strings", false, false, data});
+    }
+
+    /* An array of integers. */
+    {
+        std::string data = "[";
+        for (size_t i = 0; data.size() < size; ++i) {
+            if (i > 0)
+                data += ", ";
+            data += std::to_string((i * 2654435761) % 1000000);
+        }
+        data += "]";
+        out.push_back(corpus{"numbers", false, false, data});
+    }
+
+    /* The sort of thing people write by hand: an array of small records
+     * with trailing commas everywhere. */
+    {
+        std::string data = "[\n";
+        for (size_t i = 0; data.size() < size; ++i) {
+            data += "  {\n";
+            data += "    \"name\": \"record " + std::to_string(i) + "\",\n";
+            data += "    \"id\": " + std::to_string(i) + ",\n";
+            data += "    \"tags\": [\"a\", \"b\", \"c\",],\n";
+            data += "  },\n";
+        }
+        data += "]\n";
+        out.push_back(corpus{"trailing_commas", true, false, data});
+    }
+
+    /* One small record per line. */
+    {
+        std::string data;
+        for (size_t i = 0; data.size() < size; ++i) {
+            data += "{\"id\": " + std::to_string(i)
+                  + ", \"name\": \"record " + std::to_string(i)
+                  + "\", \"values\": [1, 2, 3]}\n";
+        }
+        out.push_back(corpus{"ndjson", false, true, data});
+    }
+
+    return out;
+}
+
+size_t allocation_count(void)
+{
+    size_t out = 0;
+    for (const auto& counter: allocation_counters)
+        out += counter.count.load();
+    return out;
+}
+
+size_t allocation_bytes(void)
+{
+    size_t out = 0;
+    for (const auto& counter: allocation_counters)
+        out += counter.bytes.load();
+    return out;
+}
+
+result measure(const corpus& c,
+               const std::string& phase,
+               size_t bytes,
+               size_t iterations,
+               std::function<void(void)> func)
+{
+    /* Allocations are reported for a single run, and the time is the best
+     * of all the runs to filter out scheduling noise. */
+    double best = 0;
+    size_t allocations = 0;
+    size_t allocated_bytes = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        auto count_start = allocation_count();
+        auto bytes_start = allocation_bytes();
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto stop = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        if (i == 0 || seconds < best)
+            best = seconds;
+        allocations = allocation_count() - count_start;
+        allocated_bytes = allocation_bytes() - bytes_start;
+    }
+
+    return result{
+        c.name,
+        phase,
+        bytes,
+        0,
+        iterations,
+        best,
+        allocations,
+        allocated_bytes,
+        peak_rss_kb()
+    };
+}
+
+void on_threads(size_t threads, std::function<void(size_t)> func)
+{
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i)
+        workers.push_back(std::thread(func, i));
+    for (auto& worker: workers)
+        worker.join();
+}
+
+/* Both walks visit every node and look up the first key of every object,
+ * returning the number of nodes seen so the work can't be optimized away. */
+size_t walk_shared(const std::shared_ptr<pson::tree>& root)
+{
+    size_t out = 0;
+    std::vector<std::shared_ptr<pson::tree>> stack;
+    stack.push_back(root);
+    while (stack.size() > 0) {
+        auto node = stack.back();
+        stack.pop_back();
+        out++;
+
+        auto array = std::dynamic_pointer_cast<pson::tree_array>(node);
+        if (array != nullptr) {
+            for (auto child: array->children())
+                stack.push_back(child);
+            continue;
+        }
+
+        auto object = std::dynamic_pointer_cast<pson::tree_object>(node);
+        if (object != nullptr) {
+            for (auto pair: object->children()) {
+                auto key = std::dynamic_pointer_cast<pson::tree_element<std::string>>(pair->key());
+                if (pair == object->children()[0] && key != nullptr)
+                    out += object->get_pair(key->value()) != nullptr;
+                stack.push_back(pair->value());
+            }
+        }
+    }
+    return out;
+}
+
+size_t walk_borrowed(const pson::tree *root)
+{
+    size_t out = 0;
+    std::vector<const pson::tree *> stack;
+    stack.push_back(root);
+    while (stack.size() > 0) {
+        auto node = stack.back();
+        stack.pop_back();
+        out++;
+
+        auto array = dynamic_cast<const pson::tree_array *>(node);
+        if (array != nullptr) {
+            for (size_t i = 0; i < array->size(); ++i)
+                stack.push_back(array->at(i));
+            continue;
+        }
+
+        auto object = dynamic_cast<const pson::tree_object *>(node);
+        if (object != nullptr) {
+            for (size_t i = 0; i < object->size(); ++i) {
+                auto pair = object->at(i);
+                auto key = dynamic_cast<const pson::tree_element<std::string> *>(pair->key().get());
+                if (i == 0 && key != nullptr)
+                    out += object->find_pair(key->value()) != nullptr;
+                stack.push_back(pair->value().get());
+            }
+        }
+    }
+    return out;
+}
+
+/* Picks locations spread all over a document, up to three levels down,
+ * so that changes land in different places. */
+std::vector<std::vector<std::string>> patch_targets(const std::shared_ptr<pson::tree>& root, size_t count)
+{
+    std::vector<std::vector<std::string>> out;
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<std::string> tokens;
+        const pson::tree *node = root.get();
+        for (size_t level = 0; level < 3; ++level) {
+            auto pick = (i * 2654435761 + level * 40503) >> 4;
+            if (auto a = dynamic_cast<const pson::tree_array *>(node)) {
+                if (a->size() == 0)
+                    break;
+                auto index = pick % a->size();
+                tokens.push_back(std::to_string(index));
+                node = a->at(index);
+            } else if (auto o = dynamic_cast<const pson::tree_object *>(node)) {
+                if (o->size() == 0)
+                    break;
+                auto pair = o->at(pick % o->size());
+                auto key = dynamic_cast<const pson::tree_element<std::string> *>(pair->key().get());
+                if (key == nullptr || o->find_pair(key->value()) != pair)
+                    break;
+                tokens.push_back(key->value());
+                node = pair->value().get();
+            } else {
+                break;
+            }
+        }
+        if (tokens.size() > 0)
+            out.push_back(tokens);
+    }
+    return out;
+}
+
+std::string pointer_to(const std::vector<std::string>& tokens)
+{
+    std::string out;
+    for (const auto& token: tokens) {
+        out += "/";
+        for (const auto& c: token) {
+            if (c == '~')
+                out += "~0";
+            else if (c == '/')
+                out += "~1";
+            else
+                out += c;
+        }
+    }
+    return out;
+}
+
+/* What changing a value in an immutable tree costs: a new copy of every
+ * array and object on the way to it. */
+std::shared_ptr<pson::tree> rebuild_replace(const std::shared_ptr<pson::tree>& node,
+                                            const std::vector<std::string>& tokens,
+                                            size_t depth,
+                                            const std::shared_ptr<pson::tree>& value)
+{
+    if (depth == tokens.size())
+        return value;
+
+    if (auto a = dynamic_cast<const pson::tree_array *>(node.get())) {
+        auto children = a->children();
+        auto index = std::stoul(tokens[depth]);
+        children[index] = rebuild_replace(children[index], tokens, depth + 1, value);
+        return std::make_shared<pson::tree_array>(children);
+    }
+
+    auto o = dynamic_cast<const pson::tree_object *>(node.get());
+    auto pairs = o->children();
+    for (auto& pair: pairs) {
+        auto key = dynamic_cast<const pson::tree_element<std::string> *>(pair->key().get());
+        if (key != nullptr && key->value() == tokens[depth]) {
+            pair = pson::make_tree_pair(pair->key(), rebuild_replace(pair->value(), tokens, depth + 1, value));
+            break;
+        }
+    }
+    return std::make_shared<pson::tree_object>(pairs);
+}
+
+long peak_rss_kb(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return usage.ru_maxrss;
+}
+
+void report_text(const std::vector<result>& results)
+{
+    std::cout << std::left
+              << std::setw(16) << "corpus"
+              << std::setw(16) << "phase"
+              << std::right
+              << std::setw(12) << "bytes"
+              << std::setw(12) << "MB/s"
+              << std::setw(12) << "Mops/s"
+              << std::setw(12) << "allocs"
+              << std::setw(14) << "alloc bytes"
+              << std::setw(12) << "peak RSS kB"
+              << "\n";
+
+    for (const auto& r: results) {
+        std::cout << std::left
+                  << std::setw(16) << r.corpus
+                  << std::setw(16) << r.phase
+                  << std::right
+                  << std::setw(12) << r.bytes
+                  << std::setw(12) << std::fixed << std::setprecision(2)
+                  << (r.bytes / r.seconds / 1e6)
+                  << std::setw(12) << (r.operations / r.seconds / 1e6)
+                  << std::setw(12) << r.allocations
+                  << std::setw(14) << r.allocated_bytes
+                  << std::setw(12) << r.peak_rss_kb
+                  << "\n";
+    }
+}
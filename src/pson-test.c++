@@ -0,0 +1,965 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Tests for the parts of the library that pson2json doesn't expose.  Each
+ * test is run by name from a script in test/pson-test/, inside a temporary
+ * directory, and prints out everything that went wrong before exiting with
+ * a non-zero status. */
+
+#include <pson/canonical.h++>
+#include <pson/columnar.h++>
+#include <pson/compression.h++>
+#include <pson/document_cache.h++>
+#include <pson/file_identity.h++>
+#include <pson/lexer.h++>
+#include <pson/merge.h++>
+#include <pson/mutable_document.h++>
+#include <pson/parallel.h++>
+#include <pson/parser.h++>
+#include <pson/push_parser.h++>
+#include <pson/record_file.h++>
+#include <pson/shared_document.h++>
+#include <pson/static_document.h++>
+#include <pson/tree.h++>
+#include <pson/writer.h++>
+#include <fcntl.h>
+#include <cmath>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static size_t failures = 0;
+
+static void expect(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAIL: " << what << "\n";
+        failures++;
+    }
+}
+
+static void write_file(const std::string& filename, const std::string& data)
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out << data;
+}
+
+/* Writes a gzip file of the given text, and then a copy of it with the
+ * end cut off. */
+static void write_damaged_gzip(const std::string& filename, const std::string& data)
+{
+    {
+        pson::compressed_ofstream out(filename + ".whole", pson::compression::GZIP);
+        out << data;
+    }
+
+    std::ifstream in(filename + ".whole", std::ios::binary);
+    std::string compressed((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    write_file(filename, compressed.substr(0, compressed.size() / 2));
+}
+
+static void test_shared_document(void);
+static void test_push_parser(void);
+static void test_document_cache(void);
+static void test_columnar(void);
+static void test_thread_pool(void);
+static void test_map_parallel_wrong_type(void);
+static void test_record_file(void);
+static void test_static_document(void);
+static void test_damaged_gzip(void);
+static void test_patch_rollback(void);
+static void test_writer(void);
+static void test_merge_sharing(void);
+
+static const struct {
+    const char *name;
+    void (*func)(void);
+} tests[] = {
+    {"shared_document", &test_shared_document},
+    {"push_parser", &test_push_parser},
+    {"document_cache", &test_document_cache},
+    {"columnar", &test_columnar},
+    {"thread_pool", &test_thread_pool},
+    {"map_parallel_wrong_type", &test_map_parallel_wrong_type},
+    {"record_file", &test_record_file},
+    {"static_document", &test_static_document},
+    {"damaged_gzip", &test_damaged_gzip},
+    {"patch_rollback", &test_patch_rollback},
+    {"writer", &test_writer},
+    {"merge_sharing", &test_merge_sharing},
+};
+
+int main(int argc, const char **argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <test>\n";
+        return 2;
+    }
+
+    for (const auto& t: tests) {
+        if (strcmp(t.name, argv[1]) == 0) {
+            t.func();
+            return failures > 0 ? 1 : 0;
+        }
+    }
+
+    std::cerr << "Unknown test " << argv[1] << "\n";
+    return 2;
+}
+
+/* Readers on several threads while the config underneath them is reloaded
+ * over and over, sometimes with a broken file.  Every version a reader sees
+ * has to be a whole one, versions never go backwards, and a broken file
+ * leaves the current version alone. */
+void test_shared_document(void)
+{
+    auto config = [](size_t n) {
+        return "{\"n\": " + std::to_string(n) + ", \"servers\": [\"a\", \"b\",], \"m\": " + std::to_string(n) + ",}";
+    };
+
+    pson::shared_document d;
+    write_file("config.pson", config(0));
+    expect(d.reload_pson_file("config.pson"), "reloading a good file");
+    expect(d.version() == 1, "the first reload publishes version 1");
+
+    write_file("config.pson", "{\"a\" 1}");
+    expect(!d.reload_pson_file("config.pson"), "a file that doesn't parse is refused");
+    expect(!d.reload_pson_file("missing.pson"), "a missing file is refused");
+    write_file("config.json", "[1, 2],");
+    expect(!d.reload_json_file("config.json"), "trailing commas are refused in JSON");
+    expect(d.version() == 1, "refused reloads don't publish anything");
+
+    write_damaged_gzip("config.pson.gz", config(1) + std::string(1 << 20, ' '));
+    expect(!d.reload_pson_file("config.pson.gz"), "a damaged gzip file is refused");
+    expect(d.version() == 1, "refused reloads don't publish anything");
+
+    auto root = std::dynamic_pointer_cast<pson::tree_object>(d.snapshot());
+    expect(root != nullptr && root->get<int>("n").data() == 0, "refused reloads leave the old version alone");
+
+    const size_t rounds = 300;
+    std::atomic<bool> done(false);
+    std::atomic<size_t> torn(0);
+    std::atomic<size_t> backwards(0);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < 4; ++i) {
+        readers.push_back(std::thread([&]() {
+            pson::shared_document::reader r(d);
+            int last = -1;
+            while (true) {
+                /* Checked after reading, so the last pass is guaranteed
+                 * to see the final version. */
+                auto finished = done.load();
+                auto o = dynamic_cast<const pson::tree_object *>(r.get());
+                auto n = o->get<int>("n").data();
+                if (n != o->get<int>("m").data())
+                    torn++;
+                if (n < last)
+                    backwards++;
+                last = n;
+                if (finished)
+                    break;
+            }
+            if (last != (int)rounds)
+                backwards++;
+        }));
+    }
+
+    size_t refused = 0;
+    for (size_t i = 1; i <= rounds; ++i) {
+        if (i % 3 == 0) {
+            write_file("config.pson", "{\"n\": " + std::to_string(i) + ", \"m\": [}");
+            refused += !d.reload_pson_file("config.pson");
+        }
+        write_file("config.pson", config(i));
+        expect(d.reload_pson_file("config.pson"), "reloading round " + std::to_string(i));
+    }
+    done = true;
+    for (auto& r: readers)
+        r.join();
+
+    expect(refused == rounds / 3, "every broken file is refused");
+    expect(d.version() == rounds + 1, "only good files are published");
+    expect(torn == 0, "readers only ever see whole versions");
+    expect(backwards == 0, "readers never go back to an older version, and end up on the newest one");
+}
+
+/* Feeds a stream to a push_parser in pieces that split at the given
+ * offsets, and describes each value that comes out: its canonical JSON, or
+ * "failed" for one that didn't parse. */
+static std::vector<std::string> push(const std::string& stream, const std::vector<size_t>& splits)
+{
+    pson::push_parser p;
+    std::vector<std::string> out;
+    auto drain = [&]() {
+        while (p.available()) {
+            auto t = p.next();
+            out.push_back(t == nullptr ? "failed" : pson::canonical_json(t));
+        }
+    };
+
+    size_t last = 0;
+    for (auto split: splits) {
+        p.feed(stream.data() + last, split - last);
+        drain();
+        last = split;
+    }
+    p.feed(stream.data() + last, stream.size() - last);
+    p.finish();
+    drain();
+    return out;
+}
+
+static void expect_push(const std::string& stream,
+                        const std::vector<size_t>& splits,
+                        const std::vector<std::string>& values)
+{
+    auto got = push(stream, splits);
+    std::string described;
+    for (const auto& v: got)
+        described += " " + v;
+    expect(got == values, "pushing " + stream + " gave" + described);
+
+    /* Splitting anywhere at all has to give the same answer. */
+    std::vector<size_t> every;
+    for (size_t i = 1; i < stream.size(); ++i)
+        every.push_back(i);
+    expect(push(stream, every) == values, "pushing " + stream + " a byte at a time");
+}
+
+/* Values are handed over as soon as they're complete, no matter where the
+ * input was split, and a malformed value is reported as a failure without
+ * getting in the way of the ones after it. */
+void test_push_parser(void)
+{
+    /* A split inside a string, and one inside an escape. */
+    expect_push("{\"na\": \"value\"} [1, 2]", {3, 12}, {"{\"na\":\"value\"}", "[1,2]"});
+    expect_push("[\"a\\\"b\", 1]", {4, 5}, {"[\"a\\\"b\",1]"});
+
+    /* Malformed values in among good ones. */
+    expect_push("{\"a\":1} {\"a\" 1} [1]", {9}, {"{\"a\":1}", "failed", "[1]"});
+    expect_push("[1] abc [2]", {5}, {"[1]", "failed", "[2]"});
+    expect_push("[1] ] [2]", {4}, {"[1]", "failed", "[2]"});
+    expect_push("[1, {\"a\": 1,, }] 5, \"s\",", {7}, {"[1,{\"a\":1}]", "5", "\"s\""});
+
+    /* A value that's still open when the input ends. */
+    expect_push("[1] [1, [2", {6}, {"[1]", "failed"});
+    expect_push("{\"a\": \"unterminated", {3}, {"failed"});
+
+    /* Too deep for the context's limit is a failure too, not an abort. */
+    pson::push_parser p;
+    p.context().set_max_depth(2);
+    p.feed("[[[1]]] [[1]]");
+    p.finish();
+    auto deep = p.next();
+    auto shallow = p.next();
+    expect(deep == nullptr && shallow != nullptr, "values nested too deeply fail");
+}
+
+/* Gives a file a particular modification time, so that rewriting it can be
+ * told apart (or not) from leaving it alone without waiting for the clock
+ * to tick. */
+static void set_mtime(const std::string& filename, time_t seconds)
+{
+    struct timespec times[2];
+    times[0].tv_sec = seconds;
+    times[0].tv_nsec = 0;
+    times[1] = times[0];
+    utimensat(AT_FDCWD, filename.c_str(), times, 0);
+}
+
+static int value_of(const std::shared_ptr<pson::tree>& t)
+{
+    auto o = std::dynamic_pointer_cast<pson::tree_object>(t);
+    return (o == nullptr) ? -1 : o->get<int>("v").data();
+}
+
+/* Unchanged files are hits, and a change to any of the size, modification
+ * time, or inode makes for a miss.  Once the cache is over its capacity
+ * the least recently used files are dropped. */
+void test_document_cache(void)
+{
+    pson::document_cache c;
+    write_file("a.pson", "{\"v\": 1,}");
+    set_mtime("a.pson", 1000000000);
+
+    auto first = c.parse_pson_file("a.pson");
+    auto second = c.parse_pson_file("a.pson");
+    expect(first != nullptr && first == second, "an unchanged file comes back as the same tree");
+    expect(c.hits() == 1 && c.misses() == 1, "the second load is a hit");
+    expect(c.parse_json_file("a.pson") != first, "JSON and PSON loads are cached separately");
+
+    write_file("a.pson", "{\"v\": 22,}");
+    set_mtime("a.pson", 1000000000);
+    expect(value_of(c.parse_pson_file("a.pson")) == 22, "a change of size is noticed");
+
+    write_file("a.pson", "{\"v\": 33,}");
+    set_mtime("a.pson", 1000000001);
+    expect(value_of(c.parse_pson_file("a.pson")) == 33, "a change of modification time is noticed");
+
+    /* A new file with the same size and time, renamed over the old one
+     * the way editors and deployment tools do. */
+    write_file("b.pson", "{\"v\": 44,}");
+    set_mtime("b.pson", 1000000001);
+    rename("b.pson", "a.pson");
+    expect(value_of(c.parse_pson_file("a.pson")) == 44, "a change of inode is noticed");
+
+    expect(c.parse_pson_file("later.pson") == nullptr, "a missing file gives nullptr");
+    write_file("later.pson", "{\"v\": 55}");
+    expect(value_of(c.parse_pson_file("later.pson")) == 55, "failures aren't cached");
+
+    /* Three files of the same size with room for only two of them. */
+    pson::document_cache small;
+    for (const auto& name: {"x.pson", "y.pson", "z.pson"})
+        write_file(name, "{\"v\": [1, 2, 3], \"name\": \"" + std::string(name) + "\"}");
+    small.parse_pson_file("x.pson");
+    auto one = small.bytes();
+    expect(one > 0, "cached trees have a size");
+    small.set_capacity(2 * one + one / 2);
+
+    small.parse_pson_file("y.pson");
+    small.parse_pson_file("x.pson");
+    small.parse_pson_file("z.pson");
+    expect(small.entries() == 2 && small.bytes() <= small.capacity(), "the cache stays under its capacity");
+
+    auto hits = small.hits();
+    small.parse_pson_file("x.pson");
+    expect(small.hits() == hits + 1, "the most recently used file is kept");
+    small.parse_pson_file("y.pson");
+    expect(small.hits() == hits + 1, "the least recently used file is dropped");
+
+    small.set_capacity(0);
+    expect(small.entries() == 0 && small.bytes() == 0, "shrinking the capacity drops what no longer fits");
+}
+
+/* Describes a column as its values, with "_" for rows that aren't valid,
+ * and checks that the validity bitmap agrees with the invalid count. */
+template<typename T> static std::string describe(const pson::column<T>& c)
+{
+    std::ostringstream out;
+    size_t invalid = 0;
+    for (size_t row = 0; row < c.size(); ++row) {
+        if (row > 0)
+            out << ",";
+        if (c.valid(row)) {
+            out << c[row];
+        } else {
+            out << "_";
+            invalid++;
+        }
+    }
+    expect(invalid == c.invalid_count(), "the invalid count of " + c.key() + " matches its bitmap");
+    expect(c.validity().size() == (c.size() + 63) / 64, "the bitmap of " + c.key() + " has a word per 64 rows");
+    return out.str();
+}
+
+/* Runs both ways of extracting the id and name columns over some input:
+ * from a parsed tree, and from the text a few bytes at a time.  The two
+ * have to agree on everything. */
+static std::string extract_both(const std::string& input, const std::vector<std::string>& path)
+{
+    pson::columns from_tree(path);
+    auto& tree_ids = from_tree.add<int>("id");
+    auto& tree_names = from_tree.add<std::string>("name");
+    auto tree_found = pson::extract_columns(pson::parse_pson_string(input), from_tree);
+
+    pson::columns from_text(path);
+    auto& text_ids = from_text.add<int>("id");
+    auto& text_names = from_text.add<std::string>("name");
+    pson::column_extractor e(from_text);
+    for (size_t i = 0; i < input.size(); i += 3)
+        e.feed(input.data() + i, std::min<size_t>(3, input.size() - i));
+    auto ok = e.finish();
+
+    auto out = "ids " + describe(tree_ids) + " names " + describe(tree_names);
+    expect(ok && e.found() == tree_found, "both ways of extracting agree on whether there's an array in " + input);
+    expect(from_tree.rows() == from_text.rows(), "both ways of extracting find as many rows in " + input);
+    expect("ids " + describe(text_ids) + " names " + describe(text_names) == out,
+           "both ways of extracting find the same values in " + input);
+    expect(tree_ids.validity() == text_ids.validity() && tree_names.validity() == text_names.validity(),
+           "both ways of extracting give the same bitmaps for " + input);
+    return tree_found ? out : "not found";
+}
+
+static std::string extract_text(const std::string& input, bool& ok)
+{
+    pson::columns cols;
+    auto& ids = cols.add<int>("id");
+    auto& names = cols.add<std::string>("name");
+    pson::column_extractor e(cols);
+    e.feed(input);
+    ok = e.finish();
+    expect(ids.size() == cols.rows() && names.size() == cols.rows(), "columns stay aligned in " + input);
+    return "ids " + describe(ids) + " names " + describe(names);
+}
+
+/* Records with the fields missing, null, of the wrong type, or not records
+ * at all each get an invalid row, and the tree and streaming extractors
+ * agree on every row and every bit. */
+void test_columnar(void)
+{
+    auto input = std::string("{\"meta\": {\"records\": 1}, \"data\": {\"records\": [\n")
+        + "  {\"id\": 1, \"name\": \"first\"},\n"
+        + "  {\"id\": null, \"name\": 2},\n"
+        + "  {\"name\": \"no id\"},\n"
+        + "  5, \"a string\", [1, 2], null,\n"
+        + "  {\"id\": 4, \"id\": \"only the first counts\", \"nested\": {\"id\": 99, \"name\": \"x\"}, \"name\": \"d\"},\n"
+        + "  {\"id\": [1], \"name\": {\"name\": \"inner\"}},\n"
+        + "  {},\n"
+        + "]}}";
+    expect(extract_both(input, {"data", "records"}) == "ids 1,_,_,_,_,_,_,4,_,_ names first,_,no id,_,_,_,_,d,_,_",
+           "columns of " + input);
+
+    /* More than 64 rows, to cross a word of the bitmap. */
+    std::string many = "[";
+    for (size_t i = 0; i < 150; ++i)
+        many += (i % 7 == 0) ? "{\"name\": null}," : "{\"id\": " + std::to_string(i) + "},";
+    many += "]";
+    extract_both(many, {});
+
+    expect(extract_both(input, {"data", "missing"}) == "not found", "a path that isn't there");
+    expect(extract_both(input, {"meta", "records"}) == "not found", "a path that leads to a scalar");
+    expect(extract_both(input, {}) == "not found", "a path that leads to an object");
+
+    /* Problems part way through a record drop that record, and keep the
+     * ones before it. */
+    bool ok = true;
+    expect(extract_text("[{\"id\": 1, \"name\": \"a\"}, {\"id\": 2, \"name\" \"b\"}, {\"id\": 3}]", ok) == "ids 1 names a" && !ok,
+           "a malformed record");
+    expect(extract_text("[{\"id\": 1}, {\"id\": 2, \"name\": [1, 2", ok) == "ids 1 names _" && !ok,
+           "input that ends inside a record");
+    expect(extract_text("[{\"id\": 1}, {\"id\": 99999999999}]", ok) == "ids 1 names _" && !ok,
+           "an unparsable token inside a record");
+}
+
+/* Loops nested inside the tasks of another loop on the same pool, and an
+ * exception thrown from one task, over and over to give ThreadSanitizer
+ * something to look at.  map_parallel() has to give back exactly what
+ * map() does. */
+void test_thread_pool(void)
+{
+    pson::thread_pool pool(8);
+    for (size_t iter = 0; iter < 300; ++iter) {
+        size_t n = iter * 37 % 5000;
+        size_t inner_n = iter % 7;
+        std::vector<size_t> out(n, 0);
+        pson::parallel_for(n, [&](size_t i) {
+            std::atomic<size_t> inner(0);
+            pson::parallel_for(inner_n, [&](size_t j) { inner += j; }, 1, pool);
+            out[i] = i * 2 + inner - inner_n * (inner_n - 1) / 2;
+        }, iter % 5, pool);
+
+        size_t wrong = 0;
+        for (size_t i = 0; i < n; ++i)
+            if (out[i] != i * 2)
+                wrong++;
+        expect(wrong == 0, "nested parallel_for, iteration " + std::to_string(iter));
+
+        bool caught = false;
+        try {
+            pool.run(100, 3, [&](size_t begin, size_t end) {
+                if (begin <= 50 && 50 < end)
+                    throw std::runtime_error("task 50");
+            });
+        } catch (const std::runtime_error& e) {
+            caught = std::string(e.what()) == "task 50";
+        }
+        expect(caught, "an exception from a task reaches run(), iteration " + std::to_string(iter));
+    }
+
+    std::string doc = "{\"a\": [";
+    for (size_t i = 0; i < 1000; ++i)
+        doc += std::to_string(i) + ", ";
+    doc += "], \"b\": [";
+    for (size_t i = 0; i < 100; ++i)
+        doc += "\"s" + std::to_string(i) + "\", ";
+    doc += "]}";
+    auto t = std::dynamic_pointer_cast<pson::tree_object>(pson::parse_pson_string(doc));
+
+    std::function<bool(std::shared_ptr<pson::tree_element<int>>)> odd =
+        [](std::shared_ptr<pson::tree_element<int>> e) { return e->value() % 2 == 1; };
+    auto seq = t->map<bool, pson::tree_element<int>>("a", odd);
+    auto par = pson::map_parallel<bool, pson::tree_element<int>>(*t, "a", odd, 7, pool);
+    expect(seq.size() == 1000 && seq == par, "map_parallel() over ints matches map()");
+
+    std::function<std::string(std::shared_ptr<pson::tree_element<std::string>>)> id =
+        [](std::shared_ptr<pson::tree_element<std::string>> e) { return e->value(); };
+    auto seq_s = t->map<std::string, pson::tree_element<std::string>>("b", id);
+    auto par_s = pson::map_parallel<std::string, pson::tree_element<std::string>>(*t, "b", id, 0, pool);
+    expect(seq_s.size() == 100 && seq_s == par_s && par_s[42] == "s42", "map_parallel() over strings matches map()");
+
+    std::atomic<size_t> sum(0);
+    pson::parallel_for(*t->find<pson::tree_array>("a"), [&](size_t, const pson::tree *c) {
+        sum += dynamic_cast<const pson::tree_element<int> *>(c)->value();
+    }, 0, pool);
+    expect(sum == 999 * 1000 / 2, "parallel_for() over an array visits every child once");
+}
+
+/* A child of the wrong type has to stop map_parallel() with a message,
+ * rather than handing func a null pointer. */
+void test_map_parallel_wrong_type(void)
+{
+    auto t = std::dynamic_pointer_cast<pson::tree_object>(pson::parse_pson_string("{\"a\": [1, 2, \"three\", 4]}"));
+    std::function<int(std::shared_ptr<pson::tree_element<int>>)> twice =
+        [](std::shared_ptr<pson::tree_element<int>> e) { return e->value() * 2; };
+    pson::map_parallel<int, pson::tree_element<int>>(*t, "a", twice);
+    std::cerr << "map_parallel() returned\n";
+}
+
+/* Overwrites part of a file without changing its inode or size. */
+static void edit_in_place(const std::string& filename, size_t offset, const std::string& data)
+{
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offset);
+    file.write(data.data(), data.size());
+}
+
+/* A saved index is only used for the file it was made from, so records
+ * edited in place (even when the file stays the same size, and even when
+ * its modification time is put back) are found all over again.  A scalar
+ * at the end of the file is a record as well. */
+void test_record_file(void)
+{
+    /* Padded out so that the records in the middle are well away from
+     * the ends of the file. */
+    auto record = [](size_t a) { return "{\"pad\": \"" + std::string(40, '.') + "\", \"a\": " + std::to_string(a) + "}"; };
+    std::string lines;
+    for (size_t i = 0; i < 400; ++i)
+        lines += record(i) + "\n";
+    write_file("records.ndjson", lines);
+
+    {
+        pson::record_file f("records.ndjson");
+        expect(f.size() == 400, "400 records");
+        expect(f.save_index(), "saving the index");
+    }
+
+    {
+        pson::record_file f("records.ndjson");
+        expect(f.size() == 400 && f.text(399) == record(399), "an unchanged file uses its saved index");
+    }
+
+    /* Record 200 grows by a byte and record 201 shrinks by one, so the
+     * file is the same size but the boundary between them has moved. */
+    auto offset = lines.find(record(200));
+    auto edit = record(2000) + "\n" + record(21);
+    edit_in_place("records.ndjson", offset, edit);
+
+    {
+        pson::record_file f("records.ndjson");
+        expect(f.size() == 400, "an edited file still has 400 records");
+        expect(f.text(200) == record(2000), "the record that grew: " + f.text(200));
+        expect(f.text(201) == record(21), "the record that shrunk: " + f.text(201));
+    }
+
+    /* The same again, with the modification time put back so that only
+     * the records themselves give the edit away. */
+    write_file("records.ndjson", lines);
+    {
+        pson::record_file f("records.ndjson");
+        f.save_index();
+    }
+    pson::file_identity before;
+    pson::stat_file("records.ndjson", before);
+    edit_in_place("records.ndjson", offset, edit);
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = before.mtime_seconds;
+    times[1].tv_nsec = before.mtime_nanoseconds;
+    utimensat(AT_FDCWD, "records.ndjson", times, 0);
+
+    {
+        pson::record_file f("records.ndjson");
+        expect(f.text(200) == record(2000) && f.text(201) == record(21),
+               "an edit hidden from the modification time is still noticed");
+    }
+
+    /* Appending keeps the saved index, and the new records are scanned. */
+    {
+        pson::record_file f("records.ndjson");
+        f.save_index();
+    }
+    std::ofstream("records.ndjson", std::ios::app | std::ios::binary) << record(400) << "\n";
+    {
+        pson::record_file f("records.ndjson");
+        expect(f.size() == 401 && f.text(400) == record(400), "records appended after the index was saved");
+    }
+
+    /* A scalar with nothing after it is indexed, but might not be
+     * finished yet. */
+    write_file("tail.ndjson", "{\"a\":1}\n{\"a\":2}\n3");
+    pson::record_file tail("tail.ndjson");
+    expect(tail.size() == 3 && tail.text(2) == "3", "a scalar at the end of the file");
+    std::ofstream("tail.ndjson", std::ios::app | std::ios::binary) << "4\n5";
+    expect(tail.refresh() == 1, "refreshing finds one more record");
+    expect(tail.size() == 4 && tail.text(2) == "34" && tail.text(3) == "5", "the scalar at the end was appended to");
+    expect(tail.save_index(), "saving an index with a scalar at the end");
+
+    pson::record_file reopened("tail.ndjson");
+    expect(reopened.size() == 4 && reopened.text(3) == "5", "reopening a file that ends in a scalar");
+
+    /* Sidecars that claim more records than they hold, or that have
+     * something after the records, aren't used. */
+    write_file("records.ndjson", lines);
+    {
+        pson::record_file f("records.ndjson");
+        f.save_index();
+    }
+    std::ifstream saved_in(pson::record_file::sidecar("records.ndjson"), std::ios::binary);
+    std::string saved((std::istreambuf_iterator<char>(saved_in)), std::istreambuf_iterator<char>());
+    const size_t count_offset = 8 + 4 * 8 + 2 * 8;
+    for (const auto& forged: {
+            saved.substr(0, count_offset) + std::string("\xff\xff\x00\x00\x00\x00\x00\x00", 8) + saved.substr(count_offset + 8),
+            saved.substr(0, count_offset) + std::string("\x91\x01\x00\x00\x00\x00\x00\x00", 8) + saved.substr(count_offset + 8),
+            saved.substr(0, count_offset) + std::string("\x8f\x01\x00\x00\x00\x00\x00\x00", 8) + saved.substr(count_offset + 8),
+            saved.substr(0, saved.size() - 8),
+            saved + std::string(16, '\0')}) {
+        write_file(pson::record_file::sidecar("records.ndjson"), forged);
+        pson::record_file f("records.ndjson");
+        expect(f.size() == 400 && f.text(399) == record(399), "a forged sidecar is ignored");
+    }
+
+    /* A malformed record comes back as nullptr, and doesn't stop the
+     * records on either side of it from parsing. */
+    write_file("malformed.ndjson", "{\"a\": 1}\n{\"a\":}\n]\n{\"a\": 3}\n");
+    pson::record_file malformed("malformed.ndjson");
+    expect(malformed.size() == 4, "a malformed record is still a record");
+    expect(malformed.parse(0) != nullptr && malformed.parse(3) != nullptr, "the records around a malformed one");
+    expect(malformed.parse(1) == nullptr, "a record with a missing value");
+    expect(malformed.parse(2) == nullptr, "a stray bracket");
+    expect(malformed.parse(0, 4).size() == 4, "parsing a range that includes malformed records");
+}
+
+/* Most of this is checked by the compiler: looking inside a value of the
+ * wrong type, or past the end of one, has to give a value that doesn't
+ * exist rather than wander off into the neighbouring nodes. */
+static constexpr auto config = PSON_STATIC(R"({
+    "port": 80,
+    "name": "server",
+    "hosts": ["a", "bb", [1, 2], {"port": 8080},],
+    "limits": {"cpu": 2, "memory": -512,},
+    "none": null,
+})");
+
+static constexpr auto root = config.root();
+static constexpr auto hosts = root.find("hosts");
+
+static_assert(root.is_object() && root.size() == 5, "the root is an object of five pairs");
+static_assert(root.find("port").as_int() == 80, "find() on an object");
+static_assert(root.find("limits").find("memory").as_int() == -512, "find() on a nested object");
+static_assert(!root.find("missing").exists(), "find() of a key that isn't there");
+static_assert(!root.find("port").find("port").exists(), "find() on an int");
+static_assert(!root.find("name").find("name").exists(), "find() on a string");
+static_assert(!hosts.find("port").exists(), "find() on an array, even one holding an object with that key");
+static_assert(!root.find("missing").find("port").exists(), "find() on a value that doesn't exist");
+
+static_assert(hosts.is_array() && hosts.size() == 4, "an array of four elements");
+static_assert(hosts.at(1).size() == 2 && hosts.at(2).at(1).as_int() == 2, "at() on an array");
+static_assert(hosts.at(3).find("port").as_int() == 8080, "find() on an object inside an array");
+static_assert(!hosts.at(4).exists(), "at() past the end of an array");
+static_assert(!root.at(0).exists(), "at() on an object");
+static_assert(!root.find("name").at(0).exists(), "at() on a string");
+
+static_assert(root.key(2).size() == 5 && root.value(2).is_array(), "key() and value() on an object");
+static_assert(!root.key(5).exists() && !root.value(5).exists(), "key() and value() past the end of an object");
+static_assert(!hosts.key(0).exists() && !hosts.value(0).exists(), "key() and value() on an array");
+
+static_assert(!root.find("missing").exists() && root.find("missing").size() == 0, "values that don't exist are empty");
+static_assert(root.find("none").is_null() && root.find("none").size() == 0, "null");
+
+static_assert(root.get<int>("port").data() == 80, "get() of an int");
+static_assert(root.find("limits").get<int>("cpu").data() == 2, "get() on a nested object");
+static_assert(!root.get<int>("missing").valid(), "get() of a key that isn't there");
+static_assert(!hosts.get<int>("port").valid(), "get() on an array");
+
+void test_static_document(void)
+{
+    auto text = std::string(R"({
+    "port": 80,
+    "name": "server",
+    "hosts": ["a", "bb", [1, 2], {"port": 8080},],
+    "limits": {"cpu": 2, "memory": -512,},
+    "none": null,
+})");
+    auto parsed = pson::canonical_json(pson::parse_pson_string(text));
+    expect(pson::canonical_json(config.to_tree()) == parsed, "to_tree() matches the parser");
+    expect(pson::canonical_json(hosts.to_tree()) == "[\"a\",\"bb\",[1,2],{\"port\":8080}]", "to_tree() of an array");
+    expect(root.find("missing").to_tree() == nullptr, "to_tree() of a value that doesn't exist");
+    expect(root.get<std::string>("name").data() == "server", "get() of a string");
+    expect(!root.find("port").get<std::string>("name").valid(), "get() on an int");
+}
+
+/* A gzip file that's been cut short has to be reported through the stream
+ * however it's read, and never by an exception escaping the library. */
+void test_damaged_gzip(void)
+{
+    std::string data = "[";
+    for (size_t i = 0; i < 20000; ++i)
+        data += "{\"id\": " + std::to_string(i) + ", \"name\": \"n" + std::to_string(i * 7919 % 10007) + "\"},\n";
+    data += "]";
+    write_damaged_gzip("data.json.gz", data);
+
+    try {
+        pson::compressed_ifstream whole("data.json.gz.whole");
+        std::string read((std::istreambuf_iterator<char>(whole)), std::istreambuf_iterator<char>());
+        expect(read == data && !whole.bad(), "an undamaged file reads back through an istreambuf_iterator");
+
+        pson::compressed_ifstream in("data.json.gz");
+        std::string partial((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        expect(in.bad(), "a damaged file sets badbit when read through an istreambuf_iterator");
+        expect(partial.size() < data.size(), "a damaged file stops where the damage is");
+
+        pson::compressed_ifstream again("data.json.gz");
+        std::vector<char> buffer(data.size());
+        again.read(buffer.data(), buffer.size());
+        expect(again.bad(), "a damaged file sets badbit when read()");
+
+        expect(pson::lexer::lex_file("data.json.gz.whole") == pson::lexer::lex_string(data), "lex_file() of an undamaged file");
+        expect(pson::lexer::lex_file("data.json.gz").size() == 0, "lex_file() of a damaged file gives no tokens");
+    } catch (const std::exception& e) {
+        expect(false, std::string("an exception escaped: ") + e.what());
+    }
+}
+
+/* Applies a patch that's expected to fail, and checks that the document
+ * (and a snapshot taken before it) are just as they were. */
+static void expect_rollback(pson::mutable_document& d, const std::string& patch, const std::string& what)
+{
+    auto before = pson::canonical_json(d.root());
+    auto snapshot = d.snapshot();
+    expect(!d.apply_patch(pson::parse_pson_string(patch)), what + " fails");
+    expect(pson::canonical_json(d.root()) == before, what + " leaves the document alone: " + pson::canonical_json(d.root()));
+    expect(pson::canonical_json(snapshot) == before, what + " leaves snapshots alone");
+}
+
+/* A patch is all or nothing: whatever the operations before a failing one
+ * did has to be undone, in the right order. */
+void test_patch_rollback(void)
+{
+    auto original = std::string(R"({
+        "name": "service",
+        "limits": {"cpu": 2, "memory": 512},
+        "hosts": ["a", "b", "c"],
+    })");
+    pson::mutable_document d(pson::parse_pson_string(original));
+
+    expect_rollback(d, R"([
+        {"op": "replace", "path": "/name", "value": "changed"},
+        {"op": "move", "from": "/hosts/2", "path": "/hosts/0"},
+        {"op": "remove", "path": "/limits/memory"},
+        {"op": "add", "path": "/limits/network", "value": {"mbps": 100}},
+        {"op": "copy", "from": "/limits", "path": "/backup"},
+        {"op": "add", "path": "/hosts/-", "value": "d"},
+        {"op": "test", "path": "/limits/cpu", "value": 3},
+    ])", "a patch ending in a failed test");
+    expect(pson::canonical_json(d.root()) == pson::canonical_json(pson::parse_pson_string(original)),
+           "the document is still the original");
+
+    expect_rollback(d, R"([
+        {"op": "move", "from": "/hosts/0", "path": "/missing/x"},
+    ])", "a move to a location whose parent is missing");
+    expect_rollback(d, R"([
+        {"op": "remove", "path": "/hosts/1"},
+        {"op": "move", "from": "/limits", "path": "/limits/cpu/x"},
+    ])", "a move into a child of itself");
+    expect_rollback(d, R"([
+        {"op": "replace", "path": "/name", "value": "changed"},
+        {"op": "move", "from": "/nothing", "path": "/name"},
+    ])", "a move from a location that isn't there");
+
+    /* After a patch that works, a failing one goes back to that rather
+     * than to the original. */
+    expect(d.apply_patch(pson::parse_pson_string(R"([{"op": "remove", "path": "/hosts/0"}])")), "a patch that works");
+    expect_rollback(d, R"([
+        {"op": "add", "path": "/hosts/0", "value": "z"},
+        {"op": "move", "from": "/hosts/0", "path": "/hosts/9"},
+    ])", "a move past the end of an array");
+    expect(pson::canonical_json(d.root()) == "{\"hosts\":[\"b\",\"c\"],\"limits\":{\"cpu\":2,\"memory\":512},\"name\":\"service\"}",
+           "the successful patch is kept: " + pson::canonical_json(d.root()));
+}
+
+/* A struct of the sort the writer is meant for, with a serializer of its
+ * own that leans on the ones for the library's types. */
+struct server {
+    std::string name;
+    int port;
+    std::vector<std::string> tags;
+    pson::option<int> weight;
+};
+
+namespace pson {
+    template<> struct serializer<server> {
+        static void write(writer& w, const server& value) {
+            w.begin_object()
+                .field("name", value.name)
+                .field("port", value.port)
+                .field("tags", value.tags)
+                .field("weight", value.weight)
+                .end_object();
+        }
+    };
+}
+
+/* Writes the same document in both formats: nested containers, empty ones,
+ * every sort of scalar, and strings that need escaping. */
+static std::string write_document(pson::writer::format format)
+{
+    pson::writer w(format);
+    std::map<std::string, std::vector<server>> pools;
+    pools["web"] = {server{"a", 80, {"edge", "tls"}, pson::option<int>(3)},
+                    server{"b", 8080, {}, pson::option<int>()}};
+    pools["empty"] = {};
+
+    w.begin_object();
+    w.field("pools", pools);
+    static const char escaped[] = "quote \" backslash \\ newline \n tab \t bell \x07 nul \0 end";
+    w.key("escaped").value(std::string(escaped, sizeof(escaped) - 1));
+    w.key("scalars").begin_array()
+        .value(-1).value(4000000000UL).value(0.5).value(true).value(false).null()
+        .value(std::nan("")).value(1.0 / 0.0)
+        .end_array();
+    w.key("nested").begin_array().begin_array().begin_object().end_object().end_array().begin_array().end_array().end_array();
+    w.end_object();
+    return w.str();
+}
+
+void test_writer(void)
+{
+    auto compact = write_document(pson::writer::format::COMPACT);
+    expect(compact == "{\"pools\":{\"empty\":[],\"web\":["
+                      "{\"name\":\"a\",\"port\":80,\"tags\":[\"edge\",\"tls\"],\"weight\":3},"
+                      "{\"name\":\"b\",\"port\":8080,\"tags\":[],\"weight\":null}]},"
+                      "\"escaped\":\"quote \\\" backslash \\\\ newline \\n tab \\t bell \\u0007 nul \\u0000 end\","
+                      "\"scalars\":[-1,4000000000,0.5,true,false,null,null,null],"
+                      "\"nested\":[[{}],[]]}",
+           "compact output: " + compact);
+
+    auto pretty = write_document(pson::writer::format::PRETTY);
+    expect(pretty == R"({
+  "pools": {
+    "empty": [],
+    "web": [
+      {
+        "name": "a",
+        "port": 80,
+        "tags": [
+          "edge",
+          "tls"
+        ],
+        "weight": 3
+      },
+      {
+        "name": "b",
+        "port": 8080,
+        "tags": [],
+        "weight": null
+      }
+    ]
+  },
+  "escaped": "quote \" backslash \\ newline \n tab \t bell \u0007 nul \u0000 end",
+  "scalars": [
+    -1,
+    4000000000,
+    0.5,
+    true,
+    false,
+    null,
+    null,
+    null
+  ],
+  "nested": [
+    [
+      {}
+    ],
+    []
+  ]
+})", "pretty output: " + pretty);
+
+    /* A single scalar is a whole document, and clear() starts over. */
+    pson::writer w(pson::writer::format::COMPACT);
+    expect(!w.complete(), "an empty writer isn't complete");
+    w.begin_array().value("x");
+    expect(!w.complete(), "an open array isn't complete");
+    w.end_array();
+    expect(w.complete() && w.str() == "[\"x\"]", "a closed array is complete");
+    w.clear();
+    w.write(server{"c", 1, {"t"}, pson::option<int>(0)});
+    expect(w.complete() && w.str() == "{\"name\":\"c\",\"port\":1,\"tags\":[\"t\"],\"weight\":0}",
+           "a custom serializer at the top level: " + w.str());
+}
+
+/* Overlays that change nothing give back the base itself, and ones that
+ * change something share everything they didn't touch. */
+void test_merge_sharing(void)
+{
+    auto base = pson::parse_pson_string(R"({
+        "name": "service",
+        "port": 80,
+        "none": null,
+        "limits": {"cpu": 2, "memory": 512},
+        "hosts": ["a", "b"],
+    })");
+    auto object = std::dynamic_pointer_cast<pson::tree_object>(base);
+    auto limits = object->find_pair("limits")->value();
+    auto hosts = object->find_pair("hosts")->value();
+
+    for (const auto& same: {"{}",
+                            R"({"name": "service"})",
+                            R"({"port": 80})",
+                            R"({"limits": {"cpu": 2}})",
+                            R"({"limits": {}, "name": "service", "port": 80})"}) {
+        expect(pson::merge(base, pson::parse_pson_string(same)) == base,
+               std::string("an overlay that changes nothing returns the base: ") + same);
+        expect(pson::merge_patch(base, pson::parse_pson_string(same)) == base,
+               std::string("a patch that changes nothing returns the target: ") + same);
+    }
+
+    expect(pson::merge(base, pson::parse_pson_string(R"({"none": null})")) == base,
+           "a null over a null changes nothing");
+
+    for (const auto& different: {R"({"name": "other"})",
+                                 R"({"port": "80"})",
+                                 R"({"none": 0})",
+                                 R"({"limits": {"cpu": 3}})",
+                                 R"({"hosts": ["a", "b"]})",
+                                 R"({"extra": 1})"}) {
+        auto merged = pson::merge(base, pson::parse_pson_string(different));
+        expect(merged != base, std::string("an overlay that changes something makes a new tree: ") + different);
+    }
+
+    auto merged = std::dynamic_pointer_cast<pson::tree_object>(pson::merge(base, pson::parse_pson_string(R"({"port": 81})")));
+    expect(merged->find_pair("limits")->value() == limits && merged->find_pair("hosts")->value() == hosts,
+           "untouched subtrees are shared");
+    expect(merged->get<int>("port").data() == 81, "the changed member");
+
+    auto cpu = std::dynamic_pointer_cast<pson::tree_object>(pson::merge(base, pson::parse_pson_string(R"({"limits": {"cpu": 2, "memory": 1024}})")));
+    auto cpu_limits = cpu->find<pson::tree_object>("limits");
+    expect(cpu_limits->find_pair("cpu") == std::dynamic_pointer_cast<pson::tree_object>(limits)->find_pair("cpu"),
+           "an equal member of a changed object is shared");
+    expect(cpu_limits->get<int>("memory").data() == 1024, "the changed member of a nested object");
+}
@@ -0,0 +1,279 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "canonical.h++"
+#include "compression.h++"
+#include "writer.h++"
+#include <simple_match/simple_match.hpp>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+using namespace pson;
+using namespace simple_match;
+using namespace simple_match::placeholders;
+
+/* Every sort of node mixes in its own tag, so (for example) an empty array
+ * and an empty object hash differently. */
+enum : uint64_t {
+    TAG_NULL = 0x6e756c6c00000001ULL,
+    TAG_INT = 0x696e740000000002ULL,
+    TAG_STRING = 0x7374720000000003ULL,
+    TAG_ARRAY = 0x6172720000000004ULL,
+    TAG_OBJECT = 0x6f626a0000000005ULL,
+};
+
+static const std::string& key_of(const tree_pair_t *pair);
+static inline uint64_t mix(uint64_t x);
+static uint64_t hash_string(const std::string& s);
+
+/* Hashes a packed array the same way as the equivalent ordinary array. */
+template<typename T, typename F>
+static uint64_t hash_packed(const std::vector<T>& values, F element);
+
+std::string pson::canonical_json(const std::shared_ptr<tree>& root)
+{
+    writer w(writer::format::COMPACT);
+
+    /* Objects have their pairs sorted up front, and each one takes two
+     * steps: the key and then the value. */
+    struct frame {
+        const tree_array *array;
+        std::vector<const tree_pair_t *> pairs;
+        size_t next;
+    };
+    std::vector<frame> stack;
+
+    auto start = [&](const std::shared_ptr<tree>& node) {
+        match (node,
+            some<tree_element<std::string>>(), [&](auto& e) {
+                w.value(e.value());
+            },
+            some<tree_element<int>>(), [&](auto& e) {
+                w.value(e.value());
+            },
+            some<tree_null>(), [&](auto& e __attribute__((unused))) {
+                w.null();
+            },
+            some<tree_packed_array<int>>(), [&](auto& e) {
+                w.begin_array();
+                for (const auto& v: e.values())
+                    w.value(v);
+                w.end_array();
+            },
+            some<tree_packed_array<std::string>>(), [&](auto& e) {
+                w.begin_array();
+                for (const auto& v: e.values())
+                    w.value(v);
+                w.end_array();
+            },
+            some<tree_array>(), [&](auto& e) {
+                w.begin_array();
+                stack.push_back(frame{&e, {}, 0});
+            },
+            some<tree_object>(), [&](auto& e) {
+                w.begin_object();
+                frame f{nullptr, {}, 0};
+                f.pairs.reserve(e.size());
+                for (size_t i = 0; i < e.size(); ++i)
+                    f.pairs.push_back(e.at(i));
+                std::stable_sort(f.pairs.begin(), f.pairs.end(),
+                                 [](const tree_pair_t *a, const tree_pair_t *b) {
+                                     return key_of(a) < key_of(b);
+                                 });
+                stack.push_back(std::move(f));
+            },
+            none(), [&](){
+                std::cerr << "Unmatched type in canonical_json()" << std::endl;
+                abort();
+            }
+        );
+    };
+
+    start(root);
+    while (stack.size() > 0) {
+        auto& top = stack.back();
+        auto index = top.next++;
+
+        if (top.array != nullptr) {
+            if (index == top.array->size()) {
+                w.end_array();
+                stack.pop_back();
+                continue;
+            }
+            start(top.array->children()[index]);
+        } else {
+            if (index == top.pairs.size() * 2) {
+                w.end_object();
+                stack.pop_back();
+                continue;
+            }
+
+            const auto pair = top.pairs[index / 2];
+            if (index % 2 == 0)
+                w.key(key_of(pair));
+            else
+                start(pair->value());
+        }
+    }
+
+    return w.str();
+}
+
+void pson::emit_canonical_json(const std::string& filename,
+                               const std::shared_ptr<tree>& root,
+                               compression compress)
+{
+    compressed_ofstream file(filename, compress);
+    file << canonical_json(root) << "\n";
+}
+
+uint64_t pson::structural_hash(const std::shared_ptr<tree>& root)
+{
+    /* Arrays fold their children in order.  Objects hash each pair on its
+     * own and then add those up, which is what makes key order not
+     * matter. */
+    struct frame {
+        const tree_array *array;
+        const tree_object *object;
+        size_t next;
+        uint64_t hash;
+        uint64_t key;
+    };
+    std::vector<frame> stack;
+    uint64_t out = 0;
+
+    /* Hands a finished hash to whatever encloses it. */
+    auto deliver = [&](uint64_t hash) {
+        if (stack.size() == 0) {
+            out = hash;
+            return;
+        }
+
+        auto& top = stack.back();
+        if (top.array != nullptr)
+            top.hash = mix(top.hash ^ hash);
+        else if (top.next % 2 == 1)
+            top.key = hash;
+        else
+            top.hash += mix(top.key * 31 + hash);
+    };
+
+    auto start = [&](const tree *node) {
+        if (auto s = dynamic_cast<const tree_element<std::string> *>(node))
+            deliver(mix(TAG_STRING ^ hash_string(s->value())));
+        else if (auto i = dynamic_cast<const tree_element<int> *>(node))
+            deliver(mix(TAG_INT ^ static_cast<uint32_t>(i->value())));
+        else if (dynamic_cast<const tree_null *>(node) != nullptr)
+            deliver(mix(TAG_NULL));
+        else if (auto p = dynamic_cast<const tree_packed_array<int> *>(node))
+            deliver(hash_packed(p->values(), [](int v) { return mix(TAG_INT ^ static_cast<uint32_t>(v)); }));
+        else if (auto p = dynamic_cast<const tree_packed_array<std::string> *>(node))
+            deliver(hash_packed(p->values(), [](const std::string& v) { return mix(TAG_STRING ^ hash_string(v)); }));
+        else if (auto a = dynamic_cast<const tree_array *>(node))
+            stack.push_back(frame{a, nullptr, 0, TAG_ARRAY, 0});
+        else if (auto o = dynamic_cast<const tree_object *>(node))
+            stack.push_back(frame{nullptr, o, 0, 0, 0});
+        else {
+            std::cerr << "Unmatched type in structural_hash()" << std::endl;
+            abort();
+        }
+    };
+
+    start(root.get());
+    while (stack.size() > 0) {
+        auto& top = stack.back();
+
+        if (top.array != nullptr) {
+            if (top.next == top.array->size()) {
+                auto hash = mix(top.hash ^ top.next);
+                stack.pop_back();
+                deliver(hash);
+                continue;
+            }
+            start(top.array->at(top.next++));
+        } else {
+            if (top.next == top.object->size() * 2) {
+                auto hash = mix(TAG_OBJECT ^ mix(top.hash + top.next));
+                stack.pop_back();
+                deliver(hash);
+                continue;
+            }
+
+            const auto pair = top.object->at(top.next / 2);
+            auto index = top.next++;
+            start(index % 2 == 0 ? pair->key().get() : pair->value().get());
+        }
+    }
+
+    return out;
+}
+
+template<typename T, typename F>
+uint64_t hash_packed(const std::vector<T>& values, F element)
+{
+    uint64_t hash = TAG_ARRAY;
+    for (const auto& v: values)
+        hash = mix(hash ^ element(v));
+    return mix(hash ^ values.size());
+}
+
+const std::string& key_of(const tree_pair_t *pair)
+{
+    auto key = dynamic_cast<const tree_element<std::string> *>(pair->key().get());
+    if (key == nullptr) {
+        std::cerr << "Canonical JSON needs string keys, got " << pair->key()->debug() << std::endl;
+        abort();
+    }
+    return key->value();
+}
+
+/* The finalizer from MurmurHash3, which is plenty to spread out the bits of
+ * each step. */
+uint64_t mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Strings are consumed eight bytes at a time.  The bytes are assembled by
+ * hand so that the result doesn't depend on the machine's byte order. */
+uint64_t hash_string(const std::string& s)
+{
+    auto data = reinterpret_cast<const unsigned char *>(s.data());
+    auto size = s.size();
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ size;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 8; ++j)
+            word |= static_cast<uint64_t>(data[i + j]) << (8 * j);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+
+    uint64_t word = 0;
+    for (size_t j = 0; i + j < size; ++j)
+        word |= static_cast<uint64_t>(data[i + j]) << (8 * j);
+    return mix(hash ^ word);
+}
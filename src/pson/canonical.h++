@@ -0,0 +1,50 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__CANONICAL_HXX
+#define LIBPSON__CANONICAL_HXX
+
+#include "compression.h++"
+#include "tree.h++"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace pson {
+    /* Canonical JSON is meant for comparing and hashing rather than for
+     * people to read: object keys are sorted (bytewise, with duplicates left
+     * in document order), strings are escaped the same way every time, and
+     * there's no whitespace at all.  Two trees that only differ in the order
+     * of their keys produce the same text.  Object keys have to be
+     * strings. */
+    std::string canonical_json(const std::shared_ptr<tree>& root);
+    void emit_canonical_json(const std::string& filename,
+                             const std::shared_ptr<tree>& root,
+                             compression compress = compression::NONE);
+
+    /* A 64-bit hash of a tree's structure that's computed straight from the
+     * tree, without writing it out.  Trees with the same canonical JSON
+     * hash the same, so comparing hashes is a cheap first check for
+     * equality.  Key order doesn't matter, not even between duplicate
+     * keys.  The hash is the same on every platform and every run, so it
+     * can be stored. */
+    uint64_t structural_hash(const std::shared_ptr<tree>& root);
+}
+
+#endif
@@ -0,0 +1,555 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "columnar.h++"
+#include "compression.h++"
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace pson;
+
+/* The same states the parser keeps for each open array or object. */
+enum class column_extractor::state: unsigned char {
+    ARRAY_FIRST,
+    ARRAY_VALUE,
+    ARRAY_COMMA,
+    OBJECT_FIRST,
+    OBJECT_KEY,
+    OBJECT_COLON,
+    OBJECT_VALUE,
+    OBJECT_COMMA,
+};
+
+/* What an open array or object is to the extraction: an object along the
+ * path to the array, the array itself, one of its records, or something
+ * that's only being checked for well-formedness. */
+enum class column_extractor::role: unsigned char {
+    SKIP,
+    PATH,
+    TARGET,
+    RECORD,
+};
+
+struct column_extractor::frame {
+    enum state state;
+    enum role role;
+
+    /* For PATH objects: whether the next step of the path has been seen
+     * already, and whether the value that's coming up is it. */
+    bool matched;
+    bool descend;
+
+    /* For RECORDs: the requests (as a range of columns::_sorted) that the
+     * value that's coming up belongs to. */
+    std::pair<size_t, size_t> requests;
+};
+
+static bool extract_file(const std::string& filename,
+                         columns& out,
+                         bool json_strict);
+
+static const size_t buffer_size = 1 << 16;
+
+columns::columns(const std::vector<std::string>& path)
+: _path(path),
+  _ints(),
+  _strings(),
+  _requests(),
+  _sorted(),
+  _rows(0)
+{
+}
+
+columns::~columns(void)
+{
+}
+
+template<> const column<int>& columns::add<int>(const std::string& key)
+{
+    if (_rows > 0) {
+        std::cerr << "Columns must be added before any rows are extracted\n";
+        abort();
+    }
+
+    _ints.push_back(std::make_unique<column<int>>(key));
+    _requests.push_back(request{key, _ints.back().get(), nullptr, SIZE_MAX});
+    _sorted.push_back(_requests.size() - 1);
+    std::stable_sort(_sorted.begin(), _sorted.end(),
+                     [&](size_t a, size_t b) { return _requests[a].key < _requests[b].key; });
+    return *_ints.back();
+}
+
+template<> const column<std::string>& columns::add<std::string>(const std::string& key)
+{
+    if (_rows > 0) {
+        std::cerr << "Columns must be added before any rows are extracted\n";
+        abort();
+    }
+
+    _strings.push_back(std::make_unique<column<std::string>>(key));
+    _requests.push_back(request{key, nullptr, _strings.back().get(), SIZE_MAX});
+    _sorted.push_back(_requests.size() - 1);
+    std::stable_sort(_sorted.begin(), _sorted.end(),
+                     [&](size_t a, size_t b) { return _requests[a].key < _requests[b].key; });
+    return *_strings.back();
+}
+
+void columns::clear(void)
+{
+    for (auto& c: _ints)
+        c->clear();
+    for (auto& c: _strings)
+        c->clear();
+    for (auto& r: _requests)
+        r.row = SIZE_MAX;
+    _rows = 0;
+}
+
+std::pair<size_t, size_t> columns::match(const char *key, size_t size) const
+{
+    auto less = [&](size_t i, int) { return _requests[i].key.compare(0, std::string::npos, key, size) < 0; };
+    auto greater = [&](int, size_t i) { return _requests[i].key.compare(0, std::string::npos, key, size) > 0; };
+    auto first = std::lower_bound(_sorted.begin(), _sorted.end(), 0, less);
+    auto last = std::upper_bound(first, _sorted.end(), 0, greater);
+    return std::make_pair(first - _sorted.begin(), last - _sorted.begin());
+}
+
+void columns::store(size_t sorted, const tree *value)
+{
+    auto& r = _requests[_sorted[sorted]];
+    if (r.row == _rows)
+        return;
+    r.row = _rows;
+
+    if (r.ints != nullptr) {
+        auto cast = dynamic_cast<const tree_element<int> *>(value);
+        if (cast != nullptr)
+            r.ints->push(cast->value());
+        else
+            r.ints->push_invalid();
+    } else {
+        auto cast = dynamic_cast<const tree_element<std::string> *>(value);
+        if (cast != nullptr)
+            r.strings->push(cast->value());
+        else
+            r.strings->push_invalid();
+    }
+}
+
+void columns::store(size_t sorted, const scalar& value)
+{
+    auto& r = _requests[_sorted[sorted]];
+    if (r.row == _rows)
+        return;
+    r.row = _rows;
+
+    if (r.ints != nullptr) {
+        if (value.kind == scalar::kind::INT)
+            r.ints->push(value.value);
+        else
+            r.ints->push_invalid();
+    } else {
+        if (value.kind == scalar::kind::STRING)
+            r.strings->push(std::string(value.data, value.size));
+        else
+            r.strings->push_invalid();
+    }
+}
+
+void columns::end_row(void)
+{
+    for (auto& r: _requests) {
+        if (r.row == _rows)
+            continue;
+        if (r.ints != nullptr)
+            r.ints->push_invalid();
+        else
+            r.strings->push_invalid();
+    }
+    _rows++;
+}
+
+void columns::abandon_row(void)
+{
+    for (auto& r: _requests) {
+        if (r.row != _rows)
+            continue;
+        if (r.ints != nullptr)
+            r.ints->pop();
+        else
+            r.strings->pop();
+        r.row = SIZE_MAX;
+    }
+}
+
+bool pson::extract_columns(const tree *root, columns& out)
+{
+    auto node = root;
+    for (const auto& key: out.path()) {
+        auto object = dynamic_cast<const tree_object *>(node);
+        if (object == nullptr)
+            return false;
+        node = object->find(key);
+    }
+
+    auto array = dynamic_cast<const tree_array *>(node);
+    if (array == nullptr)
+        return false;
+
+    for (size_t i = 0; i < array->size(); ++i) {
+        auto record = dynamic_cast<const tree_object *>(array->at(i));
+        if (record != nullptr) {
+            for (size_t j = 0; j < record->size(); ++j) {
+                auto pair = record->at(j);
+                auto key = dynamic_cast<const tree_element<std::string> *>(pair->key().get());
+                if (key == nullptr)
+                    continue;
+
+                auto requests = out.match(key->value().data(), key->value().size());
+                for (auto r = requests.first; r < requests.second; ++r)
+                    out.store(r, pair->value().get());
+            }
+        }
+        out.end_row();
+    }
+    return true;
+}
+
+bool pson::extract_json_file_columns(const std::string& filename, columns& out)
+{
+    return extract_file(filename, out, true);
+}
+
+bool pson::extract_pson_file_columns(const std::string& filename, columns& out)
+{
+    return extract_file(filename, out, false);
+}
+
+column_extractor::column_extractor(columns& out,
+                                   bool json_strict,
+                                   size_t max_depth)
+: _columns(out),
+  _json_strict(json_strict),
+  _max_depth(max_depth),
+  _tokens(),
+  _lexer(_tokens),
+  _stack(),
+  _have_value(false),
+  _found(false),
+  _failed(false)
+{
+}
+
+column_extractor::~column_extractor(void)
+{
+}
+
+bool column_extractor::feed(const char *data, size_t size)
+{
+    if (_failed)
+        return false;
+
+    _lexer.feed(data, size);
+    auto count = _lexer.size();
+    for (size_t i = 0; i < count && !_failed; ++i)
+        token(_tokens[i]);
+    _lexer.discard(count);
+    return !_failed;
+}
+
+bool column_extractor::finish(void)
+{
+    if (_failed)
+        return false;
+
+    auto count = _lexer.finish();
+    for (size_t i = 0; i < count && !_failed; ++i)
+        token(_tokens[i]);
+    _lexer.discard(count);
+
+    if (!_failed && (_stack.size() > 0 || !_have_value))
+        fail("Unable to parse tokens: input ended early");
+    return !_failed;
+}
+
+void column_extractor::token(const lexer::token& token)
+{
+    if (_stack.size() == 0) {
+        if (!_have_value)
+            value(token);
+        else if (!_json_strict && token == ",")
+            {}
+        else
+            fail("Extra token after JSON file: " + std::string(token.begin(), token.end()));
+        return;
+    }
+
+    auto& top = _stack.back().state;
+    switch (top) {
+    case state::ARRAY_FIRST:
+    case state::OBJECT_FIRST:
+        if (token == "]" || token == "}")
+            close(token);
+        else
+            value(token);
+        break;
+
+    case state::ARRAY_VALUE:
+    case state::OBJECT_KEY:
+        if (token == "]" || token == "}")
+            close(token);
+        else if (token != ",")
+            value(token);
+        break;
+
+    case state::OBJECT_VALUE:
+        value(token);
+        break;
+
+    case state::ARRAY_COMMA:
+    case state::OBJECT_COMMA:
+        if (token == ",")
+            top = (top == state::ARRAY_COMMA) ? state::ARRAY_VALUE : state::OBJECT_KEY;
+        else if (token == "]" || token == "}")
+            close(token);
+        else
+            fail("Missing comma before " + std::string(token.begin(), token.end()));
+        break;
+
+    case state::OBJECT_COLON:
+        if (token != ":")
+            return fail("Missing : after object key");
+        top = state::OBJECT_VALUE;
+        break;
+    }
+}
+
+void column_extractor::value(const lexer::token& token)
+{
+    if (token == "[" || token == "{") {
+        if (_stack.size() >= _max_depth)
+            return fail("Exceeded maximum nesting depth of " + std::to_string(_max_depth));
+
+        /* Arrays and objects have no place in a column, and an element of
+         * the array that isn't a record is a row without any values. */
+        auto role = place(token);
+        if (_stack.size() > 0 && _stack.back().role == role::RECORD) {
+            auto& top = _stack.back();
+            if (top.state == state::OBJECT_VALUE)
+                for (auto r = top.requests.first; r < top.requests.second; ++r)
+                    _columns.store(r, columns::scalar{columns::scalar::kind::OTHER, nullptr, 0, 0});
+            else
+                top.requests = std::make_pair(0, 0);
+        }
+        if (_stack.size() > 0 && _stack.back().role == role::TARGET && role != role::RECORD)
+            _columns.end_row();
+
+        if (role == role::TARGET)
+            _found = true;
+
+        auto is_array = (token == "[");
+        _stack.push_back(frame{is_array ? state::ARRAY_FIRST : state::OBJECT_FIRST,
+                               role, false, false, std::make_pair(0, 0)});
+        return;
+    }
+
+    /* This matches the parser's own checks, including the std::stoi()
+     * behavior for numbers. */
+    auto s = columns::scalar{columns::scalar::kind::OTHER, nullptr, 0, 0};
+    if (token[0] == '"') {
+        if (token.size() < 2 || token[token.size() - 1] != '"')
+            return fail("Malformed string: no trailing \"");
+        s.kind = columns::scalar::kind::STRING;
+        s.data = token.data() + 1;
+        s.size = token.size() - 2;
+    } else if (token != "null") {
+        char *end;
+        errno = 0;
+        auto value = strtol(token.c_str(), &end, 10);
+        if (end == token.c_str() || errno == ERANGE || value < INT_MIN || value > INT_MAX)
+            return fail("Unparsable token " + std::string(token.begin(), token.end()));
+        s.kind = columns::scalar::kind::INT;
+        s.value = value;
+    }
+
+    if (_stack.size() > 0) {
+        auto& top = _stack.back();
+        auto is_key = (top.state == state::OBJECT_FIRST || top.state == state::OBJECT_KEY);
+        auto is_string = (s.kind == columns::scalar::kind::STRING);
+
+        switch (top.role) {
+        case role::SKIP:
+            break;
+
+        case role::PATH:
+            if (is_key) {
+                const auto& step = _columns.path()[_stack.size() - 1];
+                top.descend = !top.matched && is_string
+                           && step.compare(0, std::string::npos, s.data, s.size) == 0;
+                top.matched = top.matched || top.descend;
+            }
+            break;
+
+        case role::TARGET:
+            _columns.end_row();
+            break;
+
+        case role::RECORD:
+            if (is_key && is_string)
+                top.requests = _columns.match(s.data, s.size);
+            else if (is_key)
+                top.requests = std::make_pair(0, 0);
+            else
+                for (auto r = top.requests.first; r < top.requests.second; ++r)
+                    _columns.store(r, s);
+            break;
+        }
+    }
+    deliver();
+}
+
+void column_extractor::close(const lexer::token& token)
+{
+    auto top = _stack.back();
+    switch (top.state) {
+    case state::ARRAY_FIRST:
+    case state::ARRAY_VALUE:
+    case state::ARRAY_COMMA:
+        if (token != "]")
+            return fail("Arrays must end with ]");
+        break;
+
+    case state::OBJECT_FIRST:
+    case state::OBJECT_KEY:
+    case state::OBJECT_COMMA:
+        if (token != "}")
+            return fail("Objects must end with }");
+        break;
+
+    case state::OBJECT_COLON:
+    case state::OBJECT_VALUE:
+        return fail("Object key without value");
+    }
+
+    if (top.role == role::RECORD)
+        _columns.end_row();
+    _stack.pop_back();
+    deliver();
+}
+
+/* Keeps track of what the innermost open array or object expects after a
+ * value has been seen in it. */
+void column_extractor::deliver(void)
+{
+    if (_stack.size() == 0) {
+        _have_value = true;
+        return;
+    }
+
+    auto& top = _stack.back().state;
+    switch (top) {
+    case state::ARRAY_FIRST:
+    case state::ARRAY_VALUE:
+        top = state::ARRAY_COMMA;
+        break;
+
+    case state::OBJECT_FIRST:
+    case state::OBJECT_KEY:
+        top = state::OBJECT_COLON;
+        break;
+
+    case state::OBJECT_VALUE:
+        top = state::OBJECT_COMMA;
+        break;
+
+    case state::ARRAY_COMMA:
+    case state::OBJECT_COLON:
+    case state::OBJECT_COMMA:
+        break;
+    }
+}
+
+/* Works out the role of an array or object that's about to start, given
+ * where it is. */
+column_extractor::role column_extractor::place(const lexer::token& token) const
+{
+    const auto& path = _columns.path();
+    auto is_array = (token == "[");
+    auto leads = [&](size_t depth) {
+        if (depth == path.size())
+            return is_array ? role::TARGET : role::SKIP;
+        return is_array ? role::SKIP : role::PATH;
+    };
+
+    if (_stack.size() == 0)
+        return leads(0);
+
+    const auto& top = _stack.back();
+    switch (top.role) {
+    case role::SKIP:
+        return role::SKIP;
+
+    case role::PATH:
+        if (top.state != state::OBJECT_VALUE || !top.descend)
+            return role::SKIP;
+        return leads(_stack.size());
+
+    case role::TARGET:
+        return is_array ? role::SKIP : role::RECORD;
+
+    case role::RECORD:
+        return role::SKIP;
+    }
+
+    return role::SKIP;
+}
+
+void column_extractor::fail(const std::string& message)
+{
+    std::cerr << message << "\n";
+    _failed = true;
+
+    /* Whatever record was being worked on never finished, so its values
+     * have to come back out again to keep the columns lined up. */
+    for (const auto& f: _stack)
+        if (f.role == role::RECORD)
+            _columns.abandon_row();
+}
+
+bool extract_file(const std::string& filename,
+                  columns& out,
+                  bool json_strict)
+{
+    compressed_ifstream in(filename);
+    if (!in)
+        return false;
+
+    column_extractor e(out, json_strict);
+    std::vector<char> buffer(buffer_size);
+    while (in && !e.failed()) {
+        in.read(buffer.data(), buffer.size());
+        e.feed(buffer.data(), in.gcount());
+    }
+    if (in.bad())
+        return false;
+    return e.finish() && e.found();
+}
@@ -0,0 +1,246 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__COLUMNAR_HXX
+#define LIBPSON__COLUMNAR_HXX
+
+#include "lexer.h++"
+#include "parser.h++"
+#include "tree.h++"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pson {
+    /* One field pulled out of every record in an array, stored as a single
+     * contiguous vector of values.  Alongside the values is a validity
+     * bitmap with one bit per row (least significant bit first), which is
+     * clear for records that didn't have the field, had it set to null, had
+     * it with some other type, or weren't objects at all.  Those rows hold a
+     * default-constructed value. */
+    template<typename T>
+    class column {
+    private:
+        const std::string _key;
+        std::vector<T> _values;
+        std::vector<uint64_t> _validity;
+        size_t _invalid;
+
+    public:
+        column(const std::string& key)
+        : _key(key),
+          _values(),
+          _validity(),
+          _invalid(0)
+        {}
+
+    public:
+        const std::string& key(void) const { return _key; }
+        size_t size(void) const { return _values.size(); }
+
+        const std::vector<T>& values(void) const { return _values; }
+        const T *data(void) const { return _values.data(); }
+        const T& operator[](size_t row) const { return _values[row]; }
+
+        const std::vector<uint64_t>& validity(void) const { return _validity; }
+        bool valid(size_t row) const { return (_validity[row / 64] >> (row % 64)) & 1; }
+        size_t invalid_count(void) const { return _invalid; }
+
+    private:
+        friend class columns;
+
+        void push(const T& value)
+        {
+            auto row = _values.size();
+            if (row % 64 == 0)
+                _validity.push_back(0);
+            _validity.back() |= uint64_t(1) << (row % 64);
+            _values.push_back(value);
+        }
+
+        void push_invalid(void)
+        {
+            if (_values.size() % 64 == 0)
+                _validity.push_back(0);
+            _values.push_back(T());
+            _invalid++;
+        }
+
+        void pop(void)
+        {
+            auto row = _values.size() - 1;
+            if (!valid(row))
+                _invalid--;
+            if (row % 64 == 0)
+                _validity.pop_back();
+            else
+                _validity.back() &= ~(uint64_t(1) << (row % 64));
+            _values.pop_back();
+        }
+
+        void clear(void)
+        {
+            _values.clear();
+            _validity.clear();
+            _invalid = 0;
+        }
+    };
+
+    /* A struct-of-arrays view of an array of records: the array is found by
+     * following a path of object keys from the root (an empty path means the
+     * root itself is the array), and each requested field becomes a
+     * column with one row per element of that array.  Only the first member
+     * with a given key counts, just like tree_object::get().
+     *
+     * Columns can be filled in from a tree that's already been parsed, with
+     * extract_columns(), or straight from the input text with a
+     * column_extractor, in which case no tree is ever built at all. */
+    class columns {
+    private:
+        struct request {
+            std::string key;
+            column<int> *ints;
+            column<std::string> *strings;
+            size_t row;
+        };
+
+    private:
+        const std::vector<std::string> _path;
+        std::vector<std::unique_ptr<column<int>>> _ints;
+        std::vector<std::unique_ptr<column<std::string>>> _strings;
+        std::vector<request> _requests;
+        std::vector<size_t> _sorted;
+        size_t _rows;
+
+    public:
+        columns(const std::vector<std::string>& path = {});
+        columns(const columns&) = delete;
+        ~columns(void);
+
+    public:
+        /* Adds a column, which must be done before any rows are extracted.
+         * Integer and string columns are supported, as those are the only
+         * scalars the parser produces.  The returned reference lives as long
+         * as this object does. */
+        template<typename T> const column<T>& add(const std::string& key);
+
+        const std::vector<std::string>& path(void) const { return _path; }
+        size_t rows(void) const { return _rows; }
+
+        /* Drops every row, but keeps the columns. */
+        void clear(void);
+
+    private:
+        friend class column_extractor;
+        friend bool extract_columns(const tree *root, columns& out);
+
+        /* A value as it appears in the input, which hasn't been turned into
+         * a tree node. */
+        struct scalar {
+            enum class kind { STRING, INT, OTHER } kind;
+            const char *data;
+            size_t size;
+            int value;
+        };
+
+        /* Records are handed over one member at a time, with end_row()
+         * after the last one.  Members are matched to columns with match(),
+         * which returns the range of _sorted whose keys are equal to the
+         * given one.  A record that turns out to be malformed part way
+         * through is dropped with abandon_row(). */
+        std::pair<size_t, size_t> match(const char *key, size_t size) const;
+        void store(size_t sorted, const tree *value);
+        void store(size_t sorted, const scalar& value);
+        void end_row(void);
+        void abandon_row(void);
+    };
+
+    template<> const column<int>& columns::add<int>(const std::string& key);
+    template<> const column<std::string>& columns::add<std::string>(const std::string& key);
+
+    /* Fills in the columns from an existing tree, appending one row per
+     * element of the array.  Returns FALSE (and adds no rows) when the path
+     * doesn't lead to an array. */
+    bool extract_columns(const tree *root, columns& out);
+    static inline bool extract_columns(const std::shared_ptr<tree>& root, columns& out)
+    { return extract_columns(root.get(), out); }
+
+    /* Fills in the columns while lexing the input, which can be handed over
+     * a piece at a time just like with a transcoder.  Nothing but the
+     * requested values is kept around: memory use depends on how deeply
+     * the input is nested, not on how big it is.
+     *
+     * Input is accepted or rejected exactly as the parser would, but
+     * problems are reported on stderr rather than aborting.  Rows that were
+     * extracted before a problem was found stay in the columns. */
+    class column_extractor {
+    private:
+        enum class state: unsigned char;
+        enum class role: unsigned char;
+        struct frame;
+
+    private:
+        columns& _columns;
+        const bool _json_strict;
+        const size_t _max_depth;
+
+        lexer::token_list _tokens;
+        lexer::chunked_lexer _lexer;
+
+        std::vector<frame> _stack;
+        bool _have_value;
+        bool _found;
+        bool _failed;
+
+    public:
+        column_extractor(columns& out,
+                         bool json_strict = false,
+                         size_t max_depth = parse_context::default_max_depth);
+        column_extractor(const column_extractor&) = delete;
+        ~column_extractor(void);
+
+    public:
+        /* Both of these return FALSE once the input has been found to be
+         * malformed. */
+        bool feed(const char *data, size_t size);
+        bool feed(const std::string& data) { return feed(data.data(), data.size()); }
+        bool finish(void);
+
+        bool failed(void) const { return _failed; }
+
+        /* TRUE once the path has led to an array. */
+        bool found(void) const { return _found; }
+
+    private:
+        void token(const lexer::token& token);
+        void value(const lexer::token& token);
+        void close(const lexer::token& token);
+        void deliver(void);
+        role place(const lexer::token& token) const;
+        void fail(const std::string& message);
+    };
+
+    /* Extracts columns from a whole file.  These return FALSE if the file
+     * is malformed or if the path doesn't lead to an array. */
+    bool extract_json_file_columns(const std::string& filename, columns& out);
+    bool extract_pson_file_columns(const std::string& filename, columns& out);
+}
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "compression.h++"
+#include <sys/stat.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+using namespace pson;
+
+/* Both directions move data around in pieces of this size. */
+static const size_t buffer_size = 1 << 16;
+
+/* zlib's window size, plus 16 to ask for a gzip header and trailer rather
+ * than a raw zlib stream. */
+static const int gzip_window_bits = 15 + 16;
+
+compression pson::detect_compression(const char *data, size_t size)
+{
+    auto bytes = reinterpret_cast<const unsigned char *>(data);
+    if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b)
+        return compression::GZIP;
+    if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd)
+        return compression::ZSTD;
+    return compression::NONE;
+}
+
+class compressed_ifstream::buffer: public std::streambuf {
+private:
+    std::ios& _stream;
+    const std::string _filename;
+    std::filebuf _file;
+    compression _format;
+    uint64_t _file_size;
+    z_stream _z;
+    bool _z_open;
+    bool _member_done;
+    bool _damaged;
+
+    /* Data straight from the file, of which [_in_begin, _in_end) hasn't
+     * been looked at yet, and what it decompressed to. */
+    std::vector<char> _in;
+    size_t _in_begin;
+    size_t _in_end;
+    std::vector<char> _out;
+
+public:
+    buffer(std::ios& stream, const std::string& filename)
+    : _stream(stream),
+      _filename(filename),
+      _file(),
+      _format(compression::NONE),
+      _file_size(0),
+      _z(),
+      _z_open(false),
+      _member_done(false),
+      _damaged(false),
+      _in(buffer_size),
+      _in_begin(0),
+      _in_end(0),
+      _out()
+    {}
+
+    ~buffer(void)
+    {
+        if (_z_open)
+            inflateEnd(&_z);
+    }
+
+public:
+    compression format(void) const { return _format; }
+    uint64_t file_size(void) const { return _file_size; }
+
+    bool open(void)
+    {
+        if (_file.open(_filename, std::ios::in | std::ios::binary) == nullptr)
+            return false;
+
+        struct stat st;
+        if (stat(_filename.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            _file_size = st.st_size;
+
+        /* The magic bytes are read like any other data, rather than being
+         * peeked at, so this works on pipes too. */
+        while (_in_end < 4) {
+            auto n = _file.sgetn(_in.data() + _in_end, _in.size() - _in_end);
+            if (n <= 0)
+                break;
+            _in_end += n;
+        }
+
+        _format = detect_compression(_in.data(), _in_end);
+        switch (_format) {
+        case compression::NONE:
+            return true;
+
+        case compression::GZIP:
+            if (inflateInit2(&_z, gzip_window_bits) != Z_OK) {
+                std::cerr << _filename << ": unable to start decompressing\n";
+                return false;
+            }
+            _z_open = true;
+            _out.resize(buffer_size);
+            return true;
+
+        case compression::ZSTD:
+            std::cerr << _filename << ": zstd-compressed files aren't supported by this build\n";
+            return false;
+        }
+
+        return false;
+    }
+
+protected:
+    virtual int_type underflow(void)
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        if (_damaged)
+            return traits_type::eof();
+
+        if (_format == compression::NONE) {
+            if (refill() == 0)
+                return traits_type::eof();
+            setg(_in.data() + _in_begin, _in.data() + _in_begin, _in.data() + _in_end);
+            _in_begin = _in_end;
+            return traits_type::to_int_type(*gptr());
+        }
+
+        while (true) {
+            if (_z.avail_in == 0) {
+                if (refill() == 0) {
+                    if (_member_done)
+                        return traits_type::eof();
+                    return damaged("compressed data ends early");
+                }
+                _z.next_in = reinterpret_cast<Bytef *>(_in.data() + _in_begin);
+                _z.avail_in = _in_end - _in_begin;
+                _in_begin = _in_end;
+            }
+
+            /* gzip files can be several compressed streams one after the
+             * other, which decompress to everything joined together. */
+            if (_member_done) {
+                inflateReset(&_z);
+                _member_done = false;
+            }
+
+            _z.next_out = reinterpret_cast<Bytef *>(_out.data());
+            _z.avail_out = _out.size();
+            auto result = inflate(&_z, Z_NO_FLUSH);
+            if (result == Z_STREAM_END)
+                _member_done = true;
+            else if (result != Z_OK && result != Z_BUF_ERROR)
+                return damaged(_z.msg != nullptr ? _z.msg : "corrupt compressed data");
+
+            auto produced = _out.size() - _z.avail_out;
+            if (produced > 0) {
+                setg(_out.data(), _out.data(), _out.data() + produced);
+                return traits_type::to_int_type(*gptr());
+            }
+        }
+    }
+
+    /* Big reads of uncompressed files go straight into the caller's
+     * buffer, which saves a copy. */
+    virtual std::streamsize xsgetn(char *s, std::streamsize n)
+    {
+        if (_format != compression::NONE)
+            return std::streambuf::xsgetn(s, n);
+
+        std::streamsize done = std::min<std::streamsize>(n, egptr() - gptr());
+        std::copy(gptr(), gptr() + done, s);
+        gbump(done);
+
+        auto pending = std::min<std::streamsize>(n - done, _in_end - _in_begin);
+        std::copy(_in.data() + _in_begin, _in.data() + _in_begin + pending, s + done);
+        _in_begin += pending;
+        done += pending;
+
+        while (done < n) {
+            auto got = _file.sgetn(s + done, n - done);
+            if (got <= 0)
+                break;
+            done += got;
+        }
+        return done;
+    }
+
+private:
+    size_t refill(void)
+    {
+        if (_in_begin == _in_end) {
+            auto n = _file.sgetn(_in.data(), _in.size());
+            _in_begin = 0;
+            _in_end = (n > 0) ? n : 0;
+        }
+        return _in_end - _in_begin;
+    }
+
+    /* Damaged data looks like the end of the file to whatever is reading
+     * it, be that the stream or an istreambuf_iterator, so the stream is
+     * marked bad directly rather than by throwing through it. */
+    int_type damaged(const std::string& why)
+    {
+        std::cerr << _filename << ": " << why << "\n";
+        _damaged = true;
+        _stream.setstate(std::ios::badbit);
+        return traits_type::eof();
+    }
+};
+
+compressed_ifstream::compressed_ifstream(const std::string& filename)
+: std::istream(nullptr),
+  _buffer(new buffer(*this, filename))
+{
+    rdbuf(_buffer.get());
+    if (!_buffer->open())
+        setstate(std::ios::failbit);
+}
+
+compressed_ifstream::~compressed_ifstream(void)
+{
+}
+
+compression compressed_ifstream::format(void) const
+{
+    return _buffer->format();
+}
+
+uint64_t compressed_ifstream::file_size(void) const
+{
+    return _buffer->file_size();
+}
+
+class compressed_ofstream::buffer: public std::streambuf {
+private:
+    std::filebuf _file;
+    compression _format;
+    z_stream _z;
+    bool _z_open;
+    std::vector<char> _in;
+    std::vector<char> _out;
+    uint64_t _written;
+
+public:
+    buffer(void)
+    : _file(),
+      _format(compression::NONE),
+      _z(),
+      _z_open(false),
+      _in(buffer_size),
+      _out(),
+      _written(0)
+    {
+        setp(_in.data(), _in.data() + _in.size());
+    }
+
+    ~buffer(void)
+    {
+        if (_z_open)
+            deflateEnd(&_z);
+    }
+
+public:
+    bool open(const std::string& filename, compression format)
+    {
+        _format = format;
+        switch (_format) {
+        case compression::NONE:
+            break;
+
+        case compression::GZIP:
+            if (deflateInit2(&_z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                std::cerr << filename << ": unable to start compressing\n";
+                return false;
+            }
+            _z_open = true;
+            _out.resize(buffer_size);
+            break;
+
+        case compression::ZSTD:
+            std::cerr << filename << ": zstd compression isn't supported by this build\n";
+            return false;
+        }
+
+        return _file.open(filename, std::ios::out | std::ios::trunc | std::ios::binary) != nullptr;
+    }
+
+    /* Writes out everything that's buffered, and then the end of the
+     * compressed stream. */
+    bool finish(void)
+    {
+        if (!_file.is_open())
+            return true;
+
+        auto ok = drain(Z_FINISH);
+        return (_file.close() != nullptr) && ok;
+    }
+
+protected:
+    virtual int_type overflow(int_type c)
+    {
+        if (!drain(Z_NO_FLUSH))
+            return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual int sync(void)
+    {
+        return (drain(Z_NO_FLUSH) && _file.pubsync() == 0) ? 0 : -1;
+    }
+
+    /* tellp() is answered with how much has been written before
+     * compression. */
+    virtual pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which)
+    {
+        if (off != 0 || dir != std::ios::cur || (which & std::ios::out) == 0)
+            return pos_type(off_type(-1));
+        return pos_type(off_type(_written + (pptr() - pbase())));
+    }
+
+private:
+    bool drain(int flush)
+    {
+        auto size = pptr() - pbase();
+        _written += size;
+        setp(_in.data(), _in.data() + _in.size());
+
+        if (_format == compression::NONE)
+            return _file.sputn(_in.data(), size) == size;
+
+        _z.next_in = reinterpret_cast<Bytef *>(_in.data());
+        _z.avail_in = size;
+        while (true) {
+            _z.next_out = reinterpret_cast<Bytef *>(_out.data());
+            _z.avail_out = _out.size();
+            auto result = deflate(&_z, flush);
+            if (result == Z_STREAM_ERROR)
+                return false;
+
+            std::streamsize produced = _out.size() - _z.avail_out;
+            if (_file.sputn(_out.data(), produced) != produced)
+                return false;
+
+            if (flush == Z_FINISH ? result == Z_STREAM_END : _z.avail_out != 0)
+                return true;
+        }
+    }
+};
+
+compressed_ofstream::compressed_ofstream(const std::string& filename,
+                                         compression format)
+: std::ostream(nullptr),
+  _buffer(new buffer())
+{
+    rdbuf(_buffer.get());
+    if (!_buffer->open(filename, format))
+        setstate(std::ios::failbit);
+}
+
+compressed_ofstream::~compressed_ofstream(void)
+{
+    close();
+}
+
+void compressed_ofstream::close(void)
+{
+    if (!_buffer->finish())
+        setstate(std::ios::badbit);
+}
@@ -0,0 +1,91 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__COMPRESSION_HXX
+#define LIBPSON__COMPRESSION_HXX
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace pson {
+    enum class compression {
+        NONE,
+        GZIP,
+        ZSTD,
+    };
+
+    /* Works out how some data is compressed from its first few bytes. */
+    compression detect_compression(const char *data, size_t size);
+
+    /* A drop-in replacement for an std::ifstream that notices compressed
+     * files by their magic bytes and decompresses them on the fly, a
+     * buffer at a time, so nothing ever has to be decompressed to a
+     * temporary file first.  Anything that isn't compressed is read as it
+     * is.  Only gzip is supported: zstd files are recognized, but this
+     * library is built without zstd so they fail to open (with a message
+     * on stderr).
+     *
+     * Compressed data that turns out to be corrupt or cut short is
+     * reported on stderr, ends the data there, and sets badbit, which is
+     * the only way to tell a damaged file from one that just ends.  That
+     * holds however the stream is read, so check bad() after reading
+     * through an istreambuf_iterator too. */
+    class compressed_ifstream: public std::istream {
+    private:
+        class buffer;
+
+    private:
+        std::unique_ptr<buffer> _buffer;
+
+    public:
+        compressed_ifstream(const std::string& filename);
+        ~compressed_ifstream(void);
+
+    public:
+        compression format(void) const;
+
+        /* How big the file is on disk, which is also how much data there
+         * is for uncompressed files.  0 if that can't be known, for
+         * pipes. */
+        uint64_t file_size(void) const;
+    };
+
+    /* The other direction, which compresses as it's written.  The
+     * compressed stream is finished off by close() or the destructor. */
+    class compressed_ofstream: public std::ostream {
+    private:
+        class buffer;
+
+    private:
+        std::unique_ptr<buffer> _buffer;
+
+    public:
+        compressed_ofstream(const std::string& filename,
+                            compression format = compression::NONE);
+        ~compressed_ofstream(void);
+
+    public:
+        void close(void);
+    };
+}
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "document_cache.h++"
+#include "parser.h++"
+#include <vector>
+using namespace pson;
+
+/* A rough count of the bytes of memory a tree is holding onto. */
+static size_t tree_bytes(const tree *root);
+
+document_cache::document_cache(size_t capacity)
+: _lock(),
+  _capacity(capacity),
+  _bytes(0),
+  _lru(),
+  _index(),
+  _hits(0),
+  _misses(0)
+{
+}
+
+document_cache& document_cache::global(void)
+{
+    static document_cache cache;
+    return cache;
+}
+
+std::shared_ptr<tree> document_cache::parse_json_file(const std::string& filename)
+{
+    return load(filename, true);
+}
+
+std::shared_ptr<tree> document_cache::parse_pson_file(const std::string& filename)
+{
+    return load(filename, false);
+}
+
+size_t document_cache::capacity(void) const
+{
+    std::unique_lock<std::mutex> l(_lock);
+    return _capacity;
+}
+
+void document_cache::set_capacity(size_t capacity)
+{
+    std::unique_lock<std::mutex> l(_lock);
+    _capacity = capacity;
+    evict();
+}
+
+size_t document_cache::bytes(void) const
+{
+    std::unique_lock<std::mutex> l(_lock);
+    return _bytes;
+}
+
+size_t document_cache::entries(void) const
+{
+    std::unique_lock<std::mutex> l(_lock);
+    return _lru.size();
+}
+
+uint64_t document_cache::hits(void) const
+{
+    std::unique_lock<std::mutex> l(_lock);
+    return _hits;
+}
+
+uint64_t document_cache::misses(void) const
+{
+    std::unique_lock<std::mutex> l(_lock);
+    return _misses;
+}
+
+void document_cache::clear(void)
+{
+    std::unique_lock<std::mutex> l(_lock);
+    _lru.clear();
+    _index.clear();
+    _bytes = 0;
+}
+
+std::shared_ptr<tree> document_cache::load(const std::string& filename, bool json_strict)
+{
+    /* JSON and PSON accept different files, so they're cached
+     * separately. */
+    auto key = (json_strict ? "json:" : "pson:") + filename;
+
+    /* The file is looked at before it's read, so if it changes while it's
+     * being parsed the next lookup will notice and parse it again. */
+    file_identity id;
+    if (!stat_file(filename, id))
+        return nullptr;
+
+    {
+        std::unique_lock<std::mutex> l(_lock);
+        auto found = _index.find(key);
+        if (found != _index.end() && found->second->id == id) {
+            _lru.splice(_lru.begin(), _lru, found->second);
+            _hits++;
+            return found->second->root;
+        }
+        _misses++;
+    }
+
+    auto root = json_strict ? pson::parse_json_file(filename) : pson::parse_pson_file(filename);
+    if (root == nullptr)
+        return nullptr;
+    auto bytes = tree_bytes(root.get());
+
+    std::unique_lock<std::mutex> l(_lock);
+    auto found = _index.find(key);
+    if (found != _index.end()) {
+        _bytes -= found->second->bytes;
+        _lru.erase(found->second);
+        _index.erase(found);
+    }
+
+    _lru.push_front(entry{key, id, root, bytes});
+    _index[key] = _lru.begin();
+    _bytes += bytes;
+    evict();
+
+    return root;
+}
+
+void document_cache::evict(void)
+{
+    while (_bytes > _capacity && _lru.size() > 0) {
+        auto& last = _lru.back();
+        _bytes -= last.bytes;
+        _index.erase(last.key);
+        _lru.pop_back();
+    }
+}
+
+size_t tree_bytes(const tree *root)
+{
+    /* Every node is charged for itself and its std::shared_ptr control
+     * block, along with whatever storage it owns. */
+    const size_t overhead = 2 * sizeof(void *);
+    size_t out = 0;
+
+    std::vector<const tree *> stack;
+    stack.push_back(root);
+    while (stack.size() > 0) {
+        auto node = stack.back();
+        stack.pop_back();
+
+        if (auto s = dynamic_cast<const tree_element<std::string> *>(node)) {
+            out += sizeof(*s) + overhead + s->value().capacity();
+        } else if (auto p = dynamic_cast<const tree_packed_array<int> *>(node)) {
+            out += sizeof(*p) + overhead + p->values().capacity() * sizeof(int);
+        } else if (auto p = dynamic_cast<const tree_packed_array<std::string> *>(node)) {
+            out += sizeof(*p) + overhead + p->values().capacity() * sizeof(std::string);
+            for (const auto& v: p->values())
+                out += v.capacity();
+        } else if (auto a = dynamic_cast<const tree_array *>(node)) {
+            out += sizeof(*a) + overhead + a->size() * sizeof(std::shared_ptr<tree>);
+            for (size_t i = 0; i < a->size(); ++i)
+                stack.push_back(a->at(i));
+        } else if (auto o = dynamic_cast<const tree_object *>(node)) {
+            out += sizeof(*o) + overhead + o->size() * sizeof(std::shared_ptr<tree_pair_t>);
+            for (size_t i = 0; i < o->size(); ++i) {
+                auto pair = o->at(i);
+                out += sizeof(tree_pair<std::shared_ptr<tree>, std::shared_ptr<tree>>) + overhead;
+                stack.push_back(pair->key().get());
+                stack.push_back(pair->value().get());
+            }
+        } else {
+            out += sizeof(tree_element<int>) + overhead;
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__DOCUMENT_CACHE_HXX
+#define LIBPSON__DOCUMENT_CACHE_HXX
+
+#include "file_identity.h++"
+#include "tree.h++"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace pson {
+    /* Remembers parsed files so that loading one again costs a stat()
+     * rather than a parse.  A file is only served from the cache while its
+     * device, inode, size, and modification time are all unchanged, and
+     * every caller gets the same tree back, which must be treated as
+     * immutable.  Once the trees held onto add up to more than the
+     * capacity, the least recently used ones are dropped (callers that
+     * still hold them keep them alive, of course).
+     *
+     * All the methods are thread safe.  Parsing happens outside the lock,
+     * so two threads missing on the same file at the same time will both
+     * parse it. */
+    class document_cache {
+    private:
+        struct entry {
+            std::string key;
+            file_identity id;
+            std::shared_ptr<tree> root;
+            size_t bytes;
+        };
+
+    private:
+        mutable std::mutex _lock;
+        size_t _capacity;
+        size_t _bytes;
+        std::list<entry> _lru;
+        std::unordered_map<std::string, std::list<entry>::iterator> _index;
+        uint64_t _hits;
+        uint64_t _misses;
+
+    public:
+        static const size_t default_capacity = 64 << 20;
+
+    public:
+        document_cache(size_t capacity = default_capacity);
+        document_cache(const document_cache&) = delete;
+
+        /* A cache shared by the whole process, for callers that would
+         * otherwise each keep their own. */
+        static document_cache& global(void);
+
+    public:
+        /* Drop-in replacements for the parser's functions of the same
+         * names, which return nullptr when the file can't be parsed (those
+         * failures aren't cached). */
+        std::shared_ptr<tree> parse_json_file(const std::string& filename);
+        std::shared_ptr<tree> parse_pson_file(const std::string& filename);
+
+        /* The capacity is an estimate of the memory used by the cached
+         * trees, in bytes. */
+        size_t capacity(void) const;
+        void set_capacity(size_t capacity);
+        size_t bytes(void) const;
+        size_t entries(void) const;
+        uint64_t hits(void) const;
+        uint64_t misses(void) const;
+
+        void clear(void);
+
+    private:
+        std::shared_ptr<tree> load(const std::string& filename, bool json_strict);
+        void evict(void);
+    };
+}
+
+#endif
@@ -18,88 +18,165 @@
  */
 
 #include "emitter.h++"
+#include "compression.h++"
 #include <simple_match/simple_match.hpp>
-#include <fstream>
 #include <iostream>
+#include <vector>
 using namespace pson;
 using namespace simple_match;
 using namespace simple_match::placeholders;
 
 /* emit() doesn't leave any trailing whitspace or commas, that's for whatever
  * is the level above to create. */
-static void emit(std::ofstream& out, size_t depth, const std::shared_ptr<tree>& root);
-static void indent(std::ofstream& out, size_t depth);
+static void emit(std::ostream& out, const std::shared_ptr<tree>& root);
+static void emit_file(const std::string& filename, const std::shared_ptr<tree>& root, compression compress, stats *s);
+static void indent(std::ostream& out, size_t depth);
 
-void pson::emit_json(const std::string& filename, const std::shared_ptr<tree>& root)
+/* Packed arrays are written straight out of their buffers, which gives the
+ * same text as going through a node per element. */
+template<typename T, typename F>
+static void emit_packed(std::ostream& out, const tree_packed_array<T>& array, size_t depth, F format);
+
+void pson::emit_json(const std::string& filename, const std::shared_ptr<tree>& root, compression compress)
+{
+    emit_file(filename, root, compress, nullptr);
+}
+
+void pson::emit_json(const std::string& filename, const std::shared_ptr<tree>& root, stats& s, compression compress)
+{
+    emit_file(filename, root, compress, &s);
+}
+
+void emit_file(const std::string& filename, const std::shared_ptr<tree>& root, compression compress, stats *s)
 {
-    std::ofstream file(filename);
-    emit(file, 0, root);
+    instrument::timer t(s, &stats::emit_seconds);
+
+    compressed_ofstream file(filename, compress);
+    emit(file, root);
     file << "\n";
+
+    auto written = file.tellp();
+    if (written > 0)
+        instrument::add(s, &stats::bytes_written, written);
 }
 
-void emit(std::ofstream& out, size_t depth, const std::shared_ptr<tree>& root)
+void emit(std::ostream& out, const std::shared_ptr<tree>& root)
 {
-    match (root,
-        some<tree_element<std::string>>(), [&](auto e) {
-            out << "\"" << e.value() << "\"";
-        },
-        some<tree_element<int>>(), [&](auto e) {
-            out << std::to_string(e.value());
-        },
-        some<tree_null>(), [&](auto e __attribute__((unused))) {
-            out << "null";
-        },
-        some<tree_array>(), [&](auto e) {
-            out << "[\n";
-
-            auto it = begin(e);
-            auto e_end = end(e);
-            while (it < e_end) {
-                indent(out, depth + 1);
-                emit(out, depth + 1, *it);
-                ++it;
-                if (it < e_end)
-                    out << ",\n";
+    /* Rather than recursing, this keeps one of these for every array or
+     * object that's in the middle of being written out.  Objects count keys
+     * and values separately, so "next" walks twice as far. */
+    struct frame {
+        const tree_array *array;
+        const tree_object *object;
+        size_t next;
+    };
+    std::vector<frame> stack;
+
+    /* Writes out a scalar, or the opening of an array or object. */
+    auto start = [&](const std::shared_ptr<tree>& node) {
+        match (node,
+            some<tree_element<std::string>>(), [&](auto& e) {
+                out << "\"" << e.value() << "\"";
+            },
+            some<tree_element<int>>(), [&](auto& e) {
+                out << std::to_string(e.value());
+            },
+            some<tree_null>(), [&](auto& e __attribute__((unused))) {
+                out << "null";
+            },
+            some<tree_packed_array<int>>(), [&](auto& e) {
+                emit_packed(out, e, stack.size(), [](const int& v) { return std::to_string(v); });
+            },
+            some<tree_packed_array<std::string>>(), [&](auto& e) {
+                emit_packed(out, e, stack.size(), [](const std::string& v) { return "\"" + v + "\""; });
+            },
+            some<tree_array>(), [&](auto& e) {
+                out << "[\n";
+                stack.push_back(frame{&e, nullptr, 0});
+            },
+            some<tree_object>(), [&](auto& e) {
+                out << "{\n";
+                stack.push_back(frame{nullptr, &e, 0});
+            },
+            none(), [&](){
+                std::cerr << "Unmatched type in emit()" << std::endl;
+                if (node == nullptr) {
+                    std::cerr << "  Cannot emit nullptr" << std::endl;
+                } else {
+                    std::cerr << "  node->debug(): " << node->debug() << std::endl;
+                }
+                std::cerr << std::endl;
+                abort();
             }
+        );
+    };
 
-            out << "\n";
-            indent(out, depth);
-            out << "]";
-        },
-        some<tree_object>(), [&](auto e) {
-            out << "{\n";
+    start(root);
+    while (stack.size() > 0) {
+        /* start() can push onto the stack, so everything needed from the
+         * top frame has to be pulled out before calling it. */
+        auto& top = stack.back();
+        auto depth = stack.size() - 1;
+        auto index = top.next++;
 
-            auto it = begin(e);
-            auto e_end = end(e);
-            while (it < e_end) {
-                indent(out, depth + 1);
-                emit(out, depth + 1, (*it)->key());
-                out << ": ";
-                emit(out, depth + 1, (*it)->value());
-                ++it;
-                if (it < e_end)
-                    out << ",\n";
+        if (top.array != nullptr) {
+            const auto& children = top.array->children();
+            if (index == children.size()) {
+                out << "\n";
+                indent(out, depth);
+                out << "]";
+                stack.pop_back();
+                continue;
             }
 
-            out << "\n";
-            indent(out, depth);
-            out << "}";
-        },
-        none(), [&](){
-            std::cerr << "Unmatched type in emit()" << std::endl;
-            if (root == nullptr) {
-                std::cerr << "  Cannot emit nullptr" << std::endl;
+            if (index > 0)
+                out << ",\n";
+            indent(out, depth + 1);
+            start(children[index]);
+        } else {
+            const auto& children = top.object->children();
+            if (index == children.size() * 2) {
+                out << "\n";
+                indent(out, depth);
+                out << "}";
+                stack.pop_back();
+                continue;
+            }
+
+            const auto& pair = children[index / 2];
+            if (index % 2 == 0) {
+                if (index > 0)
+                    out << ",\n";
+                indent(out, depth + 1);
+                start(pair->key());
             } else {
-                std::cerr << "  root->debug(): " << root->debug() << std::endl;
+                out << ": ";
+                start(pair->value());
             }
-            std::cerr << std::endl;
-            abort();
         }
-    );
+    }
 }
 
-void indent(std::ofstream& out, size_t depth)
+void indent(std::ostream& out, size_t depth)
 {
     for (size_t i = 0; i < depth; ++i)
         out << "  ";
 }
+
+template<typename T, typename F>
+void emit_packed(std::ostream& out, const tree_packed_array<T>& array, size_t depth, F format)
+{
+    std::string text = "[\n";
+    std::string prefix(2 * (depth + 1), ' ');
+    const auto& values = array.values();
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0)
+            text += ",\n";
+        text += prefix;
+        text += format(values[i]);
+    }
+    text += "\n";
+    text.append(2 * depth, ' ');
+    text += "]";
+    out << text;
+}
@@ -20,13 +20,22 @@
 #ifndef LIBPSON__EMITTER_HXX
 #define LIBPSON__EMITTER_HXX
 
+#include "compression.h++"
+#include "stats.h++"
 #include "tree.h++"
 #include <memory>
 #include <string>
 
 namespace pson {
-    /* Writes a JSON tree out to a file. */
-    void emit_json(const std::string& filename, const std::shared_ptr<tree>& root);
+    /* Writes a JSON tree out to a file, which can optionally be
+     * compressed. */
+    void emit_json(const std::string& filename,
+                   const std::shared_ptr<tree>& root,
+                   compression compress = compression::NONE);
+    void emit_json(const std::string& filename,
+                   const std::shared_ptr<tree>& root,
+                   stats& s,
+                   compression compress = compression::NONE);
 }
 
 #endif
@@ -0,0 +1,67 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "file_identity.h++"
+#include <sys/stat.h>
+using namespace pson;
+
+static void identify(const struct stat& st, file_identity& id);
+
+bool file_identity::operator==(const file_identity& other) const
+{
+    return device == other.device
+        && inode == other.inode
+        && size == other.size
+        && mtime_seconds == other.mtime_seconds
+        && mtime_nanoseconds == other.mtime_nanoseconds;
+}
+
+bool pson::stat_file(const std::string& filename, file_identity& id)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+
+    identify(st, id);
+    return true;
+}
+
+bool pson::stat_file(int fd, file_identity& id)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return false;
+
+    identify(st, id);
+    return true;
+}
+
+void identify(const struct stat& st, file_identity& id)
+{
+    id.device = st.st_dev;
+    id.inode = st.st_ino;
+    id.size = st.st_size;
+    id.mtime_seconds = st.st_mtime;
+#if defined(__APPLE__)
+    id.mtime_nanoseconds = st.st_mtimespec.tv_nsec;
+#else
+    id.mtime_nanoseconds = st.st_mtim.tv_nsec;
+#endif
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef LIBPSON__FILE_IDENTITY_HXX
+#define LIBPSON__FILE_IDENTITY_HXX
+
+#include <cstdint>
+#include <string>
+
+namespace pson {
+    /* Which version of a file is on disk: something that's been replaced
+     * or rewritten will differ in at least one of these.  Modification
+     * times are kept to the nanosecond where the platform has them, as
+     * a second is plenty of time for a file to change twice. */
+    struct file_identity {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_seconds;
+        int64_t mtime_nanoseconds;
+
+        bool operator==(const file_identity& other) const;
+        bool operator!=(const file_identity& other) const { return !(*this == other); }
+    };
+
+    /* Both return FALSE if the file can't be looked at, in which case the
+     * identity is left alone. */
+    bool stat_file(const std::string& filename, file_identity& id);
+    bool stat_file(int fd, file_identity& id);
+}
+
+#endif
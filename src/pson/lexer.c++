@@ -18,9 +18,10 @@
  */
 
 #include "lexer.h++"
-#include <fstream>
-#include <sstream>
-#include <stack>
+#include "compression.h++"
+#include <algorithm>
+#include <iterator>
+#include <memory>
 using namespace pson;
 
 enum state {
@@ -29,40 +30,182 @@ enum state {
     ESCAPE
 };
 
+/* The lexer itself works on any sort of token list, so it can fill in both
+ * the heap-allocated and the memory_resource flavors.  Any tokens already in
+ * the list get overwritten in place (so their storage is reused).  All the
+ * lexer's state lives in here rather than on the stack, so input can be fed
+ * in as many pieces as is convenient: a chunk can end anywhere, even in the
+ * middle of a token or an escape sequence. */
+template<typename V>
+class machine {
+private:
+    typedef typename V::value_type token_t;
+
+private:
+    V& _out;
+    token_t _token;
+
+    /* The deepest the lexer ever gets is an escape inside a string. */
+    state _states[3];
+    size_t _depth;
+    size_t _count;
+
+public:
+    machine(V& out);
+
+public:
+    void feed(const char *data, size_t size);
+
+    /* Flushes out whatever token is still being built and returns the
+     * number of tokens lexed. */
+    size_t finish(void);
+
+    void discard(size_t count);
+
+    size_t count(void) const { return _count; }
+
+private:
+    inline void emit(void);
+};
+
+template<typename V>
+static size_t lex(const std::string& data, V& out);
+
 std::vector<std::string> lexer::lex_file(const std::string& filename)
 {
-    std::ifstream file(filename);
-    file >> std::noskipws;
+    compressed_ifstream file(filename);
     return lex_stream(file);
 }
 
 std::vector<std::string> lexer::lex_string(const std::string& data)
 {
-    std::istringstream ss(data);
-    ss >> std::noskipws;
-    return lex_stream(ss);
+    std::vector<std::string> out;
+    lex(data, out);
+    return out;
 }
 
 std::vector<std::string> lexer::lex_stream(std::istream& file)
 {
-    char c;
-    std::string token = "";
-    std::vector<std::string> out;
+    std::string data((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    if (file.bad())
+        return std::vector<std::string>();
+    return lex_string(data);
+}
 
-    std::stack<state> state_stack;
-    state_stack.push(state::BODY);
+lexer::token_list lexer::lex_string(const std::string& data, memory_resource *mr)
+{
+    token_list out{allocator<token>(mr)};
+    lex(data, out);
+    return out;
+}
+
+size_t lexer::lex_string(const std::string& data, token_list& tokens)
+{
+    return lex(data, tokens);
+}
+
+template<typename V>
+size_t lex(const std::string& data, V& out)
+{
+    machine<V> m(out);
+    m.feed(data.data(), data.size());
+    return m.finish();
+}
 
-    while (file >> c) {
-        switch (state_stack.top()) {
+struct lexer::chunked_lexer::machine: public ::machine<token_list> {
+    machine(token_list& tokens)
+    : ::machine<token_list>(tokens)
+    {}
+};
+
+lexer::chunked_lexer::chunked_lexer(token_list& tokens)
+: _machine(new machine(tokens))
+{
+}
+
+lexer::chunked_lexer::~chunked_lexer(void)
+{
+}
+
+void lexer::chunked_lexer::feed(const char *data, size_t size)
+{
+    _machine->feed(data, size);
+}
+
+size_t lexer::chunked_lexer::size(void) const
+{
+    return _machine->count();
+}
+
+size_t lexer::chunked_lexer::finish(void)
+{
+    return _machine->finish();
+}
+
+void lexer::chunked_lexer::discard(size_t count)
+{
+    _machine->discard(count);
+}
+
+template<typename V>
+machine<V>::machine(V& out)
+: _out(out),
+  _token(typename token_t::allocator_type(out.get_allocator())),
+  _depth(1),
+  _count(0)
+{
+    _states[0] = state::BODY;
+}
+
+/* Swapping the finished token into an old slot hands that slot's buffer back
+ * to be filled with the next token. */
+template<typename V>
+inline void machine<V>::emit(void)
+{
+    if (_count < _out.size())
+        _out[_count].swap(_token);
+    else
+        _out.push_back(std::move(_token));
+    _count++;
+    _token.clear();
+}
+
+template<typename V>
+size_t machine<V>::finish(void)
+{
+    if (_token.size() > 0)
+        emit();
+    return _count;
+}
+
+/* The discarded tokens are rotated past the end rather than erased, so their
+ * buffers get reused for later tokens. */
+template<typename V>
+void machine<V>::discard(size_t count)
+{
+    if (count > _count)
+        count = _count;
+    std::rotate(_out.begin(), _out.begin() + count, _out.begin() + _count);
+    _count -= count;
+}
+
+template<typename V>
+void machine<V>::feed(const char *data, size_t size)
+{
+    auto& token = _token;
+    for (size_t i = 0; i < size; ++i) {
+        auto c = data[i];
+        switch (_states[_depth - 1]) {
         case state::BODY:
             switch (c) {
             case '\\':
-                state_stack.push(state::ESCAPE);
+                _states[_depth++] = state::ESCAPE;
                 break;
 
             case '"':
-                state_stack.push(state::STRING);
-                token = token + c;
+                _states[_depth++] = state::STRING;
+                token.push_back(c);
                 break;
 
             case '[':
@@ -72,11 +215,9 @@ std::vector<std::string> lexer::lex_stream(std::istream& file)
             case ',':
             case ':':
                 if (token.size() > 0)
-                    out.push_back(token);
-                token = c;
-                if (token.size() > 0)
-                    out.push_back(token);
-                token = "";
+                    emit();
+                token.assign(1, c);
+                emit();
                 break;
 
             case ' ':
@@ -85,37 +226,31 @@ std::vector<std::string> lexer::lex_stream(std::istream& file)
                 break;
 
             default:
-                token = token + c;
+                token.push_back(c);
             }
             break;
 
         case state::STRING:
             switch (c) {
             case '\\':
-                state_stack.push(state::ESCAPE);
+                _states[_depth++] = state::ESCAPE;
                 break;
 
             case '"':
-                state_stack.pop();
-                token = token + c;
-                if (token.size() > 0)
-                    out.push_back(token);
-                token = "";
+                _depth--;
+                token.push_back(c);
+                emit();
                 break;
 
             default:
-                token = token + c;
+                token.push_back(c);
             }
             break;
 
         case state::ESCAPE:
-            token = token + c;
-            state_stack.pop();
+            token.push_back(c);
+            _depth--;
             break;
         }
     }
-    if (token.size() > 0)
-        out.push_back(token);
-
-    return out;
 }
@@ -20,16 +20,67 @@
 #ifndef LIBPSON__LEXER_HXX
 #define LIBPSON__LEXER_HXX
 
+#include "memory.h++"
 #include <istream>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace pson {
     namespace lexer {
-        /* A hand-written JSON (or PSON) lexer. */
+        /* A hand-written JSON (or PSON) lexer.  A stream that goes bad
+         * part way through, like a damaged compressed file, gives no
+         * tokens at all rather than the ones from before the damage. */
         std::vector<std::string> lex_file(const std::string& filename);
         std::vector<std::string> lex_string(const std::string& data);
         std::vector<std::string> lex_stream(std::istream& data);
+
+        /* The same lexer, but with the tokens (and the list that holds them)
+         * allocated from a memory_resource rather than the global heap. */
+        typedef std::basic_string<char, std::char_traits<char>, allocator<char>> token;
+        typedef std::vector<token, allocator<token>> token_list;
+        token_list lex_string(const std::string& data, memory_resource *mr);
+
+        /* Lexes into an existing token list, overwriting the tokens that are
+         * already there so their storage gets reused.  Returns the number of
+         * tokens lexed, anything past that in the list is stale. */
+        size_t lex_string(const std::string& data, token_list& tokens);
+
+        /* A lexer that's handed its input a piece at a time, for when the
+         * whole document isn't available up front.  Chunks can be split
+         * anywhere, including in the middle of a token, a string, or an
+         * escape sequence.  Tokens are written into the given list the same
+         * way lex_string() does, overwriting what's already there. */
+        class chunked_lexer {
+        private:
+            struct machine;
+
+        private:
+            std::unique_ptr<machine> _machine;
+
+        public:
+            chunked_lexer(token_list& tokens);
+            chunked_lexer(const chunked_lexer&) = delete;
+            ~chunked_lexer(void);
+
+        public:
+            void feed(const char *data, size_t size);
+            void feed(const std::string& data) { feed(data.data(), data.size()); }
+
+            /* The number of tokens that are known to be complete so far:
+             * the last one might still be growing. */
+            size_t size(void) const;
+
+            /* Signals the end of the input, which completes the last token,
+             * and returns the total number of tokens. */
+            size_t finish(void);
+
+            /* Drops the first count complete tokens, shifting the rest
+             * down to the front of the list.  This lets a caller that's
+             * done with the start of the input keep the list from growing
+             * without bound. */
+            void discard(size_t count);
+        };
     }
 }
 
@@ -0,0 +1,107 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "memory.h++"
+#include <cstdint>
+#include <new>
+using namespace pson;
+
+namespace {
+    class new_delete_memory_resource: public memory_resource {
+    protected:
+        virtual void *do_allocate(size_t bytes, size_t alignment)
+        { return ::operator new(bytes); }
+
+        virtual void do_deallocate(void *p, size_t bytes, size_t alignment)
+        { ::operator delete(p); }
+    };
+}
+
+memory_resource *pson::new_delete_resource(void)
+{
+    static new_delete_memory_resource resource;
+    return &resource;
+}
+
+monotonic_buffer_resource::monotonic_buffer_resource(size_t initial_size,
+                                                     memory_resource *upstream)
+: _upstream(upstream == nullptr ? new_delete_resource() : upstream),
+  _next_size(initial_size < sizeof(block) ? sizeof(block) : initial_size),
+  _blocks(nullptr),
+  _current(nullptr),
+  _available(0)
+{
+}
+
+monotonic_buffer_resource::~monotonic_buffer_resource(void)
+{
+    release();
+    if (_blocks != nullptr)
+        _upstream->deallocate(_blocks, _blocks->size);
+}
+
+void monotonic_buffer_resource::release(void)
+{
+    if (_blocks == nullptr)
+        return;
+
+    auto keep = _blocks;
+    for (auto b = keep->next; b != nullptr;) {
+        auto next = b->next;
+        _upstream->deallocate(b, b->size);
+        b = next;
+    }
+
+    keep->next = nullptr;
+    _blocks = keep;
+    _current = reinterpret_cast<char *>(keep + 1);
+    _available = keep->size - sizeof(*keep);
+}
+
+void *monotonic_buffer_resource::do_allocate(size_t bytes, size_t alignment)
+{
+    auto pad = (alignment - reinterpret_cast<uintptr_t>(_current) % alignment) % alignment;
+    if (_current == nullptr || pad + bytes > _available) {
+        /* Blocks double in size every time we run out, so there's only ever
+         * a logarithmic number of trips to the upstream resource. */
+        auto size = _next_size;
+        while (size < sizeof(block) + bytes + alignment)
+            size *= 2;
+        _next_size = size * 2;
+
+        auto b = static_cast<block *>(_upstream->allocate(size));
+        b->next = _blocks;
+        b->size = size;
+        _blocks = b;
+        _current = reinterpret_cast<char *>(b + 1);
+        _available = size - sizeof(*b);
+
+        pad = (alignment - reinterpret_cast<uintptr_t>(_current) % alignment) % alignment;
+    }
+
+    auto out = _current + pad;
+    _current += pad + bytes;
+    _available -= pad + bytes;
+    return out;
+}
+
+void monotonic_buffer_resource::do_deallocate(void *p, size_t bytes, size_t alignment)
+{
+    /* Individual frees are a no-op, memory is only returned by release(). */
+}
@@ -0,0 +1,132 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__MEMORY_HXX
+#define LIBPSON__MEMORY_HXX
+
+#include <cstddef>
+
+namespace pson {
+    /* A source of memory that the parser can be told to use instead of the
+     * global heap.  This mirrors C++17's std::pmr::memory_resource, which
+     * isn't available in the C++ version pson targets. */
+    class memory_resource {
+    public:
+        virtual ~memory_resource(void) {}
+
+    public:
+        void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+        { return do_allocate(bytes, alignment); }
+
+        void deallocate(void *p, size_t bytes, size_t alignment = alignof(std::max_align_t))
+        { return do_deallocate(p, bytes, alignment); }
+
+        bool is_equal(const memory_resource& other) const
+        { return do_is_equal(other); }
+
+    protected:
+        virtual void *do_allocate(size_t bytes, size_t alignment) = 0;
+        virtual void do_deallocate(void *p, size_t bytes, size_t alignment) = 0;
+        virtual bool do_is_equal(const memory_resource& other) const
+        { return this == &other; }
+    };
+
+    /* The resource that just forwards to the global operator new, which is
+     * what gets used when nobody asks for anything else. */
+    memory_resource *new_delete_resource(void);
+
+    /* Hands out memory by bumping a pointer through large blocks, and never
+     * frees anything until release() is called or the resource is
+     * destroyed.  This isn't thread safe, so the intended use is one of
+     * these per request (or per thread), which makes allocation nearly free
+     * and keeps every node of a document close together.  Anything
+     * allocated from here must be dead before release() is called. */
+    class monotonic_buffer_resource: public memory_resource {
+    private:
+        struct block {
+            block *next;
+            size_t size;
+        };
+
+    private:
+        memory_resource *_upstream;
+        size_t _next_size;
+        block *_blocks;
+        char *_current;
+        size_t _available;
+
+    public:
+        monotonic_buffer_resource(size_t initial_size = 4096,
+                                  memory_resource *upstream = new_delete_resource());
+        monotonic_buffer_resource(const monotonic_buffer_resource&) = delete;
+        virtual ~monotonic_buffer_resource(void);
+
+    public:
+        /* Frees everything that's been allocated.  The most recent block
+         * (which is the largest, as blocks grow geometrically) is kept
+         * around so a resource that's released between requests settles
+         * into not touching the upstream resource at all. */
+        void release(void);
+
+        memory_resource *upstream_resource(void) const { return _upstream; }
+
+    protected:
+        virtual void *do_allocate(size_t bytes, size_t alignment);
+        virtual void do_deallocate(void *p, size_t bytes, size_t alignment);
+    };
+
+    /* A standard allocator that gets its memory from a memory_resource,
+     * which is how containers and std::allocate_shared get pointed at
+     * one. */
+    template<typename T> class allocator {
+    private:
+        memory_resource *_resource;
+
+    public:
+        typedef T value_type;
+
+    public:
+        allocator(memory_resource *resource = new_delete_resource())
+        : _resource(resource == nullptr ? new_delete_resource() : resource)
+        {}
+
+        template<typename U> allocator(const allocator<U>& other)
+        : _resource(other.resource())
+        {}
+
+    public:
+        T *allocate(size_t n)
+        { return static_cast<T*>(_resource->allocate(n * sizeof(T), alignof(T))); }
+
+        void deallocate(T *p, size_t n)
+        { _resource->deallocate(p, n * sizeof(T), alignof(T)); }
+
+        memory_resource *resource(void) const { return _resource; }
+    };
+
+    template<typename T, typename U>
+    static inline bool operator==(const allocator<T>& a, const allocator<U>& b)
+    { return a.resource() == b.resource() || a.resource()->is_equal(*b.resource()); }
+
+    template<typename T, typename U>
+    static inline bool operator!=(const allocator<T>& a, const allocator<U>& b)
+    { return !(a == b); }
+}
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "merge.h++"
+#include <string>
+#include <unordered_map>
+using namespace pson;
+
+static std::shared_ptr<tree> combine(const std::shared_ptr<tree>& base,
+                                     const std::shared_ptr<tree>& overlay,
+                                     bool nulls_remove);
+static bool same_scalar(const tree *a, const tree *b);
+
+std::shared_ptr<tree> pson::merge(const std::shared_ptr<tree>& base,
+                                  const std::shared_ptr<tree>& overlay)
+{
+    return combine(base, overlay, false);
+}
+
+std::shared_ptr<tree> pson::merge(const std::vector<std::shared_ptr<tree>>& layers)
+{
+    std::shared_ptr<tree> out = nullptr;
+    for (const auto& layer: layers)
+        out = (out == nullptr) ? layer : combine(out, layer, false);
+    return out;
+}
+
+std::shared_ptr<tree> pson::merge_patch(const std::shared_ptr<tree>& target,
+                                        const std::shared_ptr<tree>& patch)
+{
+    return combine(target, patch, true);
+}
+
+/* This recurses, but only where both sides have an object, so it goes no
+ * deeper than the overlay does: for parsed trees that's bounded by the
+ * parser's maximum depth. */
+std::shared_ptr<tree> combine(const std::shared_ptr<tree>& base,
+                              const std::shared_ptr<tree>& overlay,
+                              bool nulls_remove)
+{
+    /* A scalar that's the same as the one it lands on changes nothing, so
+     * the base's node is kept rather than the overlay's. */
+    auto o = dynamic_cast<const tree_object *>(overlay.get());
+    if (o == nullptr)
+        return same_scalar(base.get(), overlay.get()) ? base : overlay;
+
+    /* A merge patch that's an object is applied to an empty object when
+     * there's no object to apply it to, which removes any nulls inside
+     * it. */
+    auto b = dynamic_cast<const tree_object *>(base.get());
+    if (b == nullptr && !nulls_remove)
+        return overlay;
+
+    auto key_of = [](const tree_pair_t *pair) {
+        return dynamic_cast<const tree_element<std::string> *>(pair->key().get());
+    };
+    auto is_null = [](const std::shared_ptr<tree>& value) {
+        return dynamic_cast<const tree_null *>(value.get()) != nullptr;
+    };
+
+    /* The first member of the overlay with each key, and whether it's been
+     * merged into a member of the base yet. */
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < o->size(); ++i)
+        if (auto key = key_of(o->at(i)))
+            index.emplace(key->value(), i);
+    std::vector<bool> used(o->size(), false);
+
+    std::vector<std::shared_ptr<tree_pair_t>> out;
+    bool changed = (b == nullptr);
+    if (b != nullptr) {
+        out.reserve(b->size() + o->size());
+        for (const auto& pair: b->children()) {
+            auto key = key_of(pair.get());
+            auto found = (key != nullptr) ? index.find(key->value()) : index.end();
+            if (found == index.end() || used[found->second]) {
+                out.push_back(pair);
+                continue;
+            }
+
+            used[found->second] = true;
+            const auto& value = o->at(found->second)->value();
+            if (nulls_remove && is_null(value)) {
+                changed = true;
+                continue;
+            }
+
+            auto merged = combine(pair->value(), value, nulls_remove);
+            if (merged == pair->value()) {
+                out.push_back(pair);
+            } else {
+                out.push_back(make_tree_pair(pair->key(), merged));
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < o->size(); ++i) {
+        const auto& pair = o->children()[i];
+        auto key = key_of(pair.get());
+        if (used[i] || (key != nullptr && index[key->value()] != i))
+            continue;
+        if (nulls_remove && is_null(pair->value()))
+            continue;
+
+        auto value = nulls_remove ? combine(nullptr, pair->value(), true) : pair->value();
+        if (value == pair->value())
+            out.push_back(pair);
+        else
+            out.push_back(make_tree_pair(pair->key(), value));
+        changed = true;
+    }
+
+    if (!changed)
+        return base;
+    return std::make_shared<tree_object>(out.begin(), out.end());
+}
+
+bool same_scalar(const tree *a, const tree *b)
+{
+    if (a == nullptr || b == nullptr)
+        return false;
+
+    if (dynamic_cast<const tree_null *>(a) != nullptr)
+        return dynamic_cast<const tree_null *>(b) != nullptr;
+
+    auto ai = dynamic_cast<const tree_element<int> *>(a);
+    auto bi = dynamic_cast<const tree_element<int> *>(b);
+    if (ai != nullptr || bi != nullptr)
+        return ai != nullptr && bi != nullptr && ai->value() == bi->value();
+
+    auto as = dynamic_cast<const tree_element<std::string> *>(a);
+    auto bs = dynamic_cast<const tree_element<std::string> *>(b);
+    if (as != nullptr || bs != nullptr)
+        return as != nullptr && bs != nullptr && as->value() == bs->value();
+
+    return false;
+}
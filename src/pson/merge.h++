@@ -0,0 +1,57 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__MERGE_HXX
+#define LIBPSON__MERGE_HXX
+
+#include "tree.h++"
+#include <memory>
+#include <vector>
+
+namespace pson {
+    /* Lays one tree over another, the way layered config files (defaults,
+     * then region, then host, say) are usually combined: where both sides
+     * have an object their members are merged key by key, all the way
+     * down, and anything else in the overlay (an array, a scalar, or a
+     * null) replaces what was underneath.  Keys keep the order they had in
+     * the base, with keys that are new in the overlay added after them.
+     * Just like get(), only the first member with a given key counts.
+     *
+     * Trees are immutable, so nothing is copied: the result shares every
+     * node that the merge didn't change with its inputs, and merging in an
+     * overlay that changes nothing returns the base itself.  A scalar (or
+     * null) equal to the one it lands on doesn't count as a change, but an
+     * array always does, even an equal one.  That makes
+     * building a config out of a handful of big files cost about as much
+     * as the overlays are big, not as much as the merged result is. */
+    std::shared_ptr<tree> merge(const std::shared_ptr<tree>& base,
+                                const std::shared_ptr<tree>& overlay);
+
+    /* Merges each layer over the ones before it, returning nullptr if there
+     * aren't any. */
+    std::shared_ptr<tree> merge(const std::vector<std::shared_ptr<tree>>& layers);
+
+    /* The same, but with RFC 7396 (JSON Merge Patch) semantics: a null in
+     * the patch removes the member it lands on rather than replacing it.
+     * The target can be nullptr, for applying a patch to nothing at all. */
+    std::shared_ptr<tree> merge_patch(const std::shared_ptr<tree>& target,
+                                      const std::shared_ptr<tree>& patch);
+}
+
+#endif
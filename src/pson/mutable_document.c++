@@ -0,0 +1,504 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mutable_document.h++"
+#include <iostream>
+using namespace pson;
+
+/* Splits a JSON Pointer into its reference tokens, undoing the ~0 and ~1
+ * escapes.  The empty pointer is the whole document. */
+static bool split_pointer(const std::string& pointer, std::vector<std::string>& out);
+
+/* Array indices are plain decimal numbers, without any leading zeros. */
+static bool array_index(const std::string& token, size_t& out);
+
+/* The value that a pointer refers to, or nullptr if there isn't one. */
+static std::shared_ptr<tree> lookup(const std::shared_ptr<tree>& root,
+                                    const std::vector<std::string>& tokens);
+
+/* Replaces every mutable array or object inside a tree with an immutable
+ * copy, sharing everything that's already immutable. */
+static std::shared_ptr<tree> freeze(const std::shared_ptr<tree>& node);
+
+/* Whether two trees have the same contents, where objects with the same
+ * members in a different order count as the same. */
+static bool same(const tree *a, const tree *b);
+
+static std::shared_ptr<tree> make_key(const std::string& key)
+{
+    return std::make_shared<tree_element<std::string>>(key);
+}
+
+mutable_document::mutable_document(const std::shared_ptr<tree>& root)
+: _root(root),
+  _log(nullptr)
+{
+}
+
+std::shared_ptr<tree> mutable_document::snapshot(void) const
+{
+    return freeze(_root);
+}
+
+const tree *mutable_document::find(const std::string& pointer) const
+{
+    std::vector<std::string> tokens;
+    if (!split_pointer(pointer, tokens))
+        return nullptr;
+    return lookup(_root, tokens).get();
+}
+
+bool mutable_document::insert(const std::string& pointer, const std::shared_ptr<tree>& value)
+{
+    slot s;
+    if (!locate(pointer, s))
+        return false;
+
+    if (s.array != nullptr && s.index > s.array->items().size()) {
+        std::cerr << "Can't insert past the end of an array at " << pointer << "\n";
+        return false;
+    }
+
+    return set(s, freeze(value), true);
+}
+
+bool mutable_document::replace(const std::string& pointer, const std::shared_ptr<tree>& value)
+{
+    slot s;
+    if (!locate(pointer, s))
+        return false;
+
+    if (!s.found) {
+        std::cerr << "Nothing to replace at " << pointer << "\n";
+        return false;
+    }
+
+    return set(s, freeze(value), false);
+}
+
+bool mutable_document::remove(const std::string& pointer)
+{
+    slot s;
+    if (!locate(pointer, s))
+        return false;
+
+    if (s.array == nullptr && s.object == nullptr) {
+        std::cerr << "Can't remove the whole document\n";
+        return false;
+    }
+
+    if (!s.found) {
+        std::cerr << "Nothing to remove at " << pointer << "\n";
+        return false;
+    }
+
+    erase(s);
+    return true;
+}
+
+bool mutable_document::apply_patch(const std::shared_ptr<tree>& patch)
+{
+    auto ops = dynamic_cast<const tree_array *>(patch.get());
+    if (ops == nullptr) {
+        std::cerr << "A JSON Patch has to be an array of operations\n";
+        return false;
+    }
+
+    std::vector<change> log;
+    _log = &log;
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < ops->size(); ++i) {
+        auto op = dynamic_cast<const tree_object *>(ops->at(i));
+        auto name = (op == nullptr) ? nullptr : op->find<tree_element<std::string>>("op");
+        auto path = (op == nullptr) ? nullptr : op->find<tree_element<std::string>>("path");
+        if (name == nullptr || path == nullptr) {
+            std::cerr << "JSON Patch operation " << i << " needs an op and a path\n";
+            ok = false;
+            break;
+        }
+
+        auto value_pair = op->find_pair("value");
+        auto value = (value_pair == nullptr) ? nullptr : value_pair->value();
+        auto from = op->find<tree_element<std::string>>("from");
+
+        const auto& n = name->value();
+        if ((n == "add" || n == "replace" || n == "test") && value == nullptr) {
+            std::cerr << "JSON Patch operation " << i << " (" << n << ") needs a value\n";
+            ok = false;
+        } else if ((n == "move" || n == "copy") && from == nullptr) {
+            std::cerr << "JSON Patch operation " << i << " (" << n << ") needs a from\n";
+            ok = false;
+        } else if (n == "add") {
+            ok = insert(path->value(), value);
+        } else if (n == "remove") {
+            ok = remove(path->value());
+        } else if (n == "replace") {
+            ok = replace(path->value(), value);
+        } else if (n == "move") {
+            /* A move is a remove and then an add, except that nothing can
+             * be moved inside of itself. */
+            const auto& f = from->value();
+            const auto& p = path->value();
+            if (f == p)
+                continue;
+            if (p.compare(0, f.size() + 1, f + "/") == 0) {
+                std::cerr << "Can't move " << f << " inside of itself\n";
+                ok = false;
+                continue;
+            }
+
+            slot s;
+            if (!locate(f, s)) {
+                ok = false;
+            } else if (!s.found) {
+                std::cerr << "Nothing to move at " << f << "\n";
+                ok = false;
+            } else if (s.array == nullptr && s.object == nullptr) {
+                std::cerr << "Can't move the whole document\n";
+                ok = false;
+            } else {
+                auto moved = get(s);
+                erase(s);
+                ok = insert(p, moved);
+            }
+        } else if (n == "copy") {
+            std::vector<std::string> tokens;
+            auto copied = split_pointer(from->value(), tokens) ? lookup(_root, tokens) : nullptr;
+            if (copied == nullptr) {
+                std::cerr << "Nothing to copy at " << from->value() << "\n";
+                ok = false;
+            } else {
+                ok = insert(path->value(), copied);
+            }
+        } else if (n == "test") {
+            auto found = find(path->value());
+            if (found == nullptr || !same(found, value.get())) {
+                std::cerr << "JSON Patch test failed at " << path->value() << "\n";
+                ok = false;
+            }
+        } else {
+            std::cerr << "Unknown JSON Patch operation " << n << "\n";
+            ok = false;
+        }
+    }
+
+    _log = nullptr;
+    if (!ok)
+        undo(log);
+    return ok;
+}
+
+/* Every array and object on the way to the location is made mutable, but
+ * as that doesn't change what's in the document it never needs undoing. */
+bool mutable_document::locate(const std::string& pointer, slot& out)
+{
+    std::vector<std::string> tokens;
+    if (!split_pointer(pointer, tokens)) {
+        std::cerr << "Invalid JSON Pointer " << pointer << "\n";
+        return false;
+    }
+
+    out = slot{nullptr, nullptr, "", true, 0};
+    for (const auto& token: tokens) {
+        if (!out.found) {
+            std::cerr << "Nothing at " << pointer << "\n";
+            return false;
+        }
+
+        auto node = get(out);
+        std::shared_ptr<tree> opened = nullptr;
+        if (auto a = dynamic_cast<const tree_array *>(node.get())) {
+            if (dynamic_cast<tree_mutable_array *>(node.get()) == nullptr)
+                opened = std::make_shared<tree_mutable_array>(a->children());
+        } else if (auto o = dynamic_cast<const tree_object *>(node.get())) {
+            if (dynamic_cast<tree_mutable_object *>(node.get()) == nullptr)
+                opened = std::make_shared<tree_mutable_object>(o->children());
+        } else {
+            std::cerr << "Nothing at " << pointer << ": it goes inside a value that isn't an array or object\n";
+            return false;
+        }
+
+        if (opened != nullptr) {
+            if (out.array != nullptr)
+                out.array->items()[out.index] = opened;
+            else if (out.object != nullptr)
+                out.object->set(out.index, opened);
+            else
+                _root = opened;
+            node = opened;
+        }
+
+        if (auto a = dynamic_cast<tree_mutable_array *>(node.get())) {
+            out = slot{a, nullptr, "", false, a->items().size()};
+            if (token != "-") {
+                if (!array_index(token, out.index)) {
+                    std::cerr << "Invalid array index " << token << " in " << pointer << "\n";
+                    return false;
+                }
+                out.found = (out.index < a->items().size());
+            }
+        } else {
+            auto o = dynamic_cast<tree_mutable_object *>(node.get());
+            auto index = o->index_of(token);
+            out = slot{nullptr, o, token, index < o->size(), index};
+        }
+    }
+
+    return true;
+}
+
+std::shared_ptr<tree> mutable_document::get(const slot& s) const
+{
+    if (s.array != nullptr)
+        return s.array->items()[s.index];
+    if (s.object != nullptr)
+        return s.object->at(s.index)->value();
+    return _root;
+}
+
+bool mutable_document::set(const slot& s, const std::shared_ptr<tree>& value, bool insert)
+{
+    if (s.array != nullptr) {
+        auto& items = s.array->items();
+        if (insert) {
+            items.insert(items.begin() + s.index, value);
+            if (_log != nullptr)
+                _log->push_back(change{change::kind::INSERTED, s.array, nullptr, s.index, nullptr, nullptr});
+        } else {
+            if (_log != nullptr)
+                _log->push_back(change{change::kind::REPLACED, s.array, nullptr, s.index, items[s.index], nullptr});
+            items[s.index] = value;
+        }
+    } else if (s.object != nullptr) {
+        auto o = s.object;
+        if (s.found) {
+            if (_log != nullptr)
+                _log->push_back(change{change::kind::REPLACED, nullptr, o, s.index, o->at(s.index)->value(), nullptr});
+            o->set(s.index, value);
+        } else {
+            o->insert(o->size(), make_tree_pair(make_key(s.key), value));
+            if (_log != nullptr)
+                _log->push_back(change{change::kind::INSERTED, nullptr, o, o->size() - 1, nullptr, nullptr});
+        }
+    } else {
+        if (_log != nullptr)
+            _log->push_back(change{change::kind::REPLACED, nullptr, nullptr, 0, _root, nullptr});
+        _root = value;
+    }
+    return true;
+}
+
+void mutable_document::erase(const slot& s)
+{
+    if (s.array != nullptr) {
+        auto& items = s.array->items();
+        if (_log != nullptr)
+            _log->push_back(change{change::kind::ERASED, s.array, nullptr, s.index, items[s.index], nullptr});
+        items.erase(items.begin() + s.index);
+    } else {
+        if (_log != nullptr)
+            _log->push_back(change{change::kind::ERASED, nullptr, s.object, s.index, nullptr, s.object->children()[s.index]});
+        s.object->erase(s.index);
+    }
+}
+
+/* Changes are undone newest first, so every index is the same as it was
+ * when the change was made. */
+void mutable_document::undo(const std::vector<change>& log)
+{
+    for (auto it = log.rbegin(); it != log.rend(); ++it) {
+        const auto& c = *it;
+        if (c.array != nullptr) {
+            auto& items = c.array->items();
+            switch (c.what) {
+            case change::kind::INSERTED:
+                items.erase(items.begin() + c.index);
+                break;
+            case change::kind::ERASED:
+                items.insert(items.begin() + c.index, c.old_child);
+                break;
+            case change::kind::REPLACED:
+                items[c.index] = c.old_child;
+                break;
+            }
+        } else if (c.object != nullptr) {
+            switch (c.what) {
+            case change::kind::INSERTED:
+                c.object->erase(c.index);
+                break;
+            case change::kind::ERASED:
+                c.object->insert(c.index, c.old_pair);
+                break;
+            case change::kind::REPLACED:
+                c.object->set(c.index, c.old_child);
+                break;
+            }
+        } else {
+            _root = c.old_child;
+        }
+    }
+}
+
+bool split_pointer(const std::string& pointer, std::vector<std::string>& out)
+{
+    out.clear();
+    if (pointer.size() == 0)
+        return true;
+    if (pointer[0] != '/')
+        return false;
+
+    std::string token;
+    for (size_t i = 1; i <= pointer.size(); ++i) {
+        if (i == pointer.size() || pointer[i] == '/') {
+            out.push_back(token);
+            token.clear();
+        } else if (pointer[i] == '~') {
+            if (i + 1 == pointer.size() || (pointer[i + 1] != '0' && pointer[i + 1] != '1'))
+                return false;
+            token += (pointer[++i] == '0') ? '~' : '/';
+        } else {
+            token += pointer[i];
+        }
+    }
+    return true;
+}
+
+bool array_index(const std::string& token, size_t& out)
+{
+    if (token.size() == 0 || token.size() > 18 || (token[0] == '0' && token.size() > 1))
+        return false;
+
+    out = 0;
+    for (const auto& c: token) {
+        if (c < '0' || c > '9')
+            return false;
+        out = out * 10 + (c - '0');
+    }
+    return true;
+}
+
+std::shared_ptr<tree> lookup(const std::shared_ptr<tree>& root,
+                             const std::vector<std::string>& tokens)
+{
+    auto node = root;
+    for (const auto& token: tokens) {
+        if (auto a = dynamic_cast<const tree_array *>(node.get())) {
+            size_t i = 0;
+            if (!array_index(token, i) || i >= a->size())
+                return nullptr;
+            node = a->children()[i];
+        } else if (auto m = dynamic_cast<const tree_mutable_object *>(node.get())) {
+            auto i = m->index_of(token);
+            if (i == m->size())
+                return nullptr;
+            node = m->at(i)->value();
+        } else if (auto o = dynamic_cast<const tree_object *>(node.get())) {
+            auto pair = o->find_pair(token);
+            if (pair == nullptr)
+                return nullptr;
+            node = pair->value();
+        } else {
+            return nullptr;
+        }
+    }
+    return node;
+}
+
+/* This recurses, but only through the parts of a document that have been
+ * changed, which are never deeper than the paths that were used. */
+std::shared_ptr<tree> freeze(const std::shared_ptr<tree>& node)
+{
+    if (auto a = dynamic_cast<const tree_mutable_array *>(node.get())) {
+        std::vector<std::shared_ptr<tree>> children;
+        children.reserve(a->size());
+        for (const auto& child: a->children())
+            children.push_back(freeze(child));
+        return std::make_shared<tree_array>(children);
+    }
+
+    if (auto o = dynamic_cast<const tree_mutable_object *>(node.get())) {
+        std::vector<std::shared_ptr<tree_pair_t>> pairs;
+        pairs.reserve(o->size());
+        for (const auto& pair: o->children()) {
+            auto value = freeze(pair->value());
+            if (value == pair->value())
+                pairs.push_back(pair);
+            else
+                pairs.push_back(make_tree_pair(pair->key(), value));
+        }
+        return std::make_shared<tree_object>(pairs);
+    }
+
+    return node;
+}
+
+bool same(const tree *a, const tree *b)
+{
+    if (auto i = dynamic_cast<const tree_element<int> *>(a)) {
+        auto j = dynamic_cast<const tree_element<int> *>(b);
+        return j != nullptr && i->value() == j->value();
+    }
+
+    if (auto s = dynamic_cast<const tree_element<std::string> *>(a)) {
+        auto t = dynamic_cast<const tree_element<std::string> *>(b);
+        return t != nullptr && s->value() == t->value();
+    }
+
+    if (dynamic_cast<const tree_null *>(a) != nullptr)
+        return dynamic_cast<const tree_null *>(b) != nullptr;
+
+    if (auto x = dynamic_cast<const tree_array *>(a)) {
+        auto y = dynamic_cast<const tree_array *>(b);
+        if (y == nullptr || x->size() != y->size())
+            return false;
+        for (size_t i = 0; i < x->size(); ++i)
+            if (!same(x->at(i), y->at(i)))
+                return false;
+        return true;
+    }
+
+    /* Every member has to be matched up with a different member of the
+     * other object, which is quadratic, but these are only used to check
+     * the values in a patch. */
+    if (auto x = dynamic_cast<const tree_object *>(a)) {
+        auto y = dynamic_cast<const tree_object *>(b);
+        if (y == nullptr || x->size() != y->size())
+            return false;
+
+        std::vector<bool> used(y->size(), false);
+        for (size_t i = 0; i < x->size(); ++i) {
+            bool matched = false;
+            for (size_t j = 0; !matched && j < y->size(); ++j) {
+                if (used[j])
+                    continue;
+                if (same(x->at(i)->key().get(), y->at(j)->key().get()) &&
+                    same(x->at(i)->value().get(), y->at(j)->value().get())) {
+                    used[j] = true;
+                    matched = true;
+                }
+            }
+            if (!matched)
+                return false;
+        }
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,239 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__MUTABLE_DOCUMENT_HXX
+#define LIBPSON__MUTABLE_DOCUMENT_HXX
+
+#include "tree.h++"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pson {
+    /* An array whose children can be changed after it's been built.  These
+     * only ever come out of a mutable_document, and to everything that
+     * just reads trees (the emitter, say) they look like any other
+     * array. */
+    class tree_mutable_array: public tree_array {
+    private:
+        std::vector<std::shared_ptr<tree>> _items;
+
+    public:
+        tree_mutable_array(const std::vector<std::shared_ptr<tree>>& children)
+        : tree_array(),
+          _items(children)
+        {}
+
+	virtual ~tree_mutable_array(void) {}
+
+    public:
+        std::vector<std::shared_ptr<tree>>& items(void) { return _items; }
+
+    public:
+        virtual const std::vector<std::shared_ptr<tree>>& children(void) const { return _items; }
+        virtual size_t size(void) const { return _items.size(); }
+        virtual const tree *at(size_t i) const { return _items[i].get(); }
+        virtual const std::string debug(void) const { return "tree_mutable_array"; }
+    };
+
+    /* The same, but for objects.  Members are changed through these
+     * methods rather than directly so that big objects can keep an index
+     * of their keys, which makes finding a member take about as long no
+     * matter how many of them there are. */
+    class tree_mutable_object: public tree_object {
+    private:
+        std::vector<std::shared_ptr<tree_pair_t>> _pairs;
+
+        /* Where the first member with each string key is.  This is built
+         * the first time a big enough object is searched, kept up to date
+         * as values are replaced and members are added at the end, and
+         * thrown away whenever members move around. */
+        mutable std::unordered_map<std::string, size_t> _index;
+        mutable bool _indexed;
+
+    public:
+        tree_mutable_object(const std::vector<std::shared_ptr<tree_pair_t>>& children)
+        : tree_object(),
+          _pairs(children),
+          _index(),
+          _indexed(false)
+        {}
+
+	virtual ~tree_mutable_object(void) {}
+
+    public:
+        /* The position of the first member with the given key, or size()
+         * if there isn't one. */
+        size_t index_of(const std::string& key_value) const
+        {
+            if (!_indexed && _pairs.size() > 8) {
+                for (size_t i = 0; i < _pairs.size(); ++i)
+                    if (auto key = string_key(i))
+                        _index.emplace(key->value(), i);
+                _indexed = true;
+            }
+
+            if (_indexed) {
+                auto found = _index.find(key_value);
+                return (found == _index.end()) ? _pairs.size() : found->second;
+            }
+
+            for (size_t i = 0; i < _pairs.size(); ++i) {
+                auto key = string_key(i);
+                if (key != nullptr && key->value() == key_value)
+                    return i;
+            }
+            return _pairs.size();
+        }
+
+        /* Replaces the value of a member, keeping its key. */
+        void set(size_t i, const std::shared_ptr<tree>& value)
+        { _pairs[i] = make_tree_pair(_pairs[i]->key(), value); }
+
+        void insert(size_t i, const std::shared_ptr<tree_pair_t>& pair)
+        {
+            _pairs.insert(_pairs.begin() + i, pair);
+            if (_indexed && i + 1 == _pairs.size()) {
+                if (auto key = string_key(i))
+                    _index.emplace(key->value(), i);
+            } else {
+                forget();
+            }
+        }
+
+        void erase(size_t i)
+        {
+            _pairs.erase(_pairs.begin() + i);
+            forget();
+        }
+
+    public:
+        virtual const std::vector<std::shared_ptr<tree_pair_t>>& children(void) const { return _pairs; }
+        virtual const std::string debug(void) const { return "tree_mutable_object"; }
+
+    private:
+        const tree_element<std::string> *string_key(size_t i) const
+        { return dynamic_cast<const tree_element<std::string> *>(_pairs[i]->key().get()); }
+
+        void forget(void)
+        {
+            _index.clear();
+            _indexed = false;
+        }
+    };
+
+    /* A document that's changed in place, for when a big tree gets lots of
+     * small edits (a config service applying a stream of patches, say) and
+     * rebuilding every ancestor of each change, as merge() has to, costs
+     * far more than the change itself.
+     *
+     * Locations are JSON Pointers (RFC 6901), like "/servers/0/port".
+     * Nothing gets copied up front: the arrays and objects along the way to
+     * a change are turned into mutable ones the first time something
+     * inside them is changed, each of them sharing all of its children with
+     * the tree the document was made from, and after that they're edited
+     * in place.  So the tree that was passed in is never modified, and
+     * repeated edits to the same part of a document only cost as much as
+     * the path to them is long.
+     *
+     * root() is what gets handed to emit_json() and the rest, but it's
+     * only valid until the next change: anything that needs to keep a
+     * version around, or share it with other threads, should take a
+     * snapshot() instead.  Documents aren't thread safe. */
+    class mutable_document {
+    private:
+        /* What it takes to put things back the way they were when a patch
+         * fails half way through. */
+        struct change {
+            enum class kind {
+                INSERTED,
+                ERASED,
+                REPLACED,
+            };
+
+            kind what;
+            tree_mutable_array *array;
+            tree_mutable_object *object;
+            size_t index;
+            std::shared_ptr<tree> old_child;
+            std::shared_ptr<tree_pair_t> old_pair;
+        };
+
+    private:
+        std::shared_ptr<tree> _root;
+        std::vector<change> *_log;
+
+    public:
+        mutable_document(const std::shared_ptr<tree>& root);
+        mutable_document(const mutable_document&) = delete;
+
+    public:
+        const std::shared_ptr<tree>& root(void) const { return _root; }
+
+        /* An immutable copy of the current version.  Only what's been
+         * changed gets copied: everything else is shared with the document,
+         * and with the tree it was made from. */
+        std::shared_ptr<tree> snapshot(void) const;
+
+        /* The value at a location, or nullptr if there isn't one.  The
+         * result is only valid until the next change. */
+        const tree *find(const std::string& pointer) const;
+
+        /* The same as the JSON Patch operations of the same names: insert()
+         * adds a new array element (before the one that's there now, or at
+         * the end for "-") or object member, or replaces the value of a
+         * member that's already there, while replace() and remove() need
+         * something to already be at the location.  Like get(), only the
+         * first member with a given key counts.  These return FALSE, after
+         * printing out why and without changing anything, when they can't
+         * be done. */
+        bool insert(const std::string& pointer, const std::shared_ptr<tree>& value);
+        bool replace(const std::string& pointer, const std::shared_ptr<tree>& value);
+        bool remove(const std::string& pointer);
+
+        /* Applies a JSON Patch (RFC 6902): an array of operations, each an
+         * object with an "op" of add, remove, replace, move, copy or test,
+         * a "path", and a "value" or "from" where the op needs one.  A patch
+         * is all or nothing, so if any of its operations fails (including a
+         * test that doesn't match) the ones before it are undone and FALSE
+         * is returned. */
+        bool apply_patch(const std::shared_ptr<tree>& patch);
+
+    private:
+        /* Where a location is: the mutable array or object that holds it,
+         * and the key or index inside that.  Both are nullptr for the
+         * root. */
+        struct slot {
+            tree_mutable_array *array;
+            tree_mutable_object *object;
+            std::string key;
+            bool found;
+            size_t index;
+        };
+
+        bool locate(const std::string& pointer, slot& out);
+        std::shared_ptr<tree> get(const slot& s) const;
+        bool set(const slot& s, const std::shared_ptr<tree>& value, bool insert);
+        void erase(const slot& s);
+        void undo(const std::vector<change>& log);
+    };
+}
+
+#endif
@@ -30,19 +30,19 @@ namespace pson {
         T _du;
 
     public:
-        option(void)
+        constexpr option(void)
         : _valid(false),
           _du()
         {}
 
-        option(const T& data)
+        constexpr option(const T& data)
         : _valid(true),
           _du(data)
         {}
 
     public:
-        bool valid(void) const { return _valid; }
-        const T& data(void) const {
+        constexpr bool valid(void) const { return _valid; }
+        constexpr const T& data(void) const {
             if (_valid == true)
                 return _du;
 
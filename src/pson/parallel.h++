@@ -0,0 +1,98 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef LIBPSON__PARALLEL_HXX
+#define LIBPSON__PARALLEL_HXX
+
+#include "thread_pool.h++"
+#include "tree.h++"
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+/* Loops over trees that are spread over the threads of a pool.  These live
+ * apart from tree.h++ so that code that doesn't want threads doesn't have
+ * to pull the pool in. */
+namespace pson {
+    /* Calls func(i, array.at(i)) for every child, and returns once all the
+     * calls have.  func has to be safe to call from several threads at a
+     * time.  See thread_pool::run() for what the grain is. */
+    template<typename F>
+    void parallel_for(const tree_array& array, F func, size_t grain = 0, thread_pool& pool = thread_pool::global())
+    {
+        pool.run(array.size(), grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                func(i, array.at(i));
+        });
+    }
+
+    /* The same as tree_object::map(), but with func called on many
+     * children at once.  The results still come back in the same order as
+     * the children.  func has to be safe to call from several threads at
+     * a time, and ret_t has to be default constructible. */
+    template<typename ret_t, typename arg_t>
+    std::vector<ret_t> map_parallel(const tree_object& object,
+                                    const std::string& key_value,
+                                    std::function<ret_t(std::shared_ptr<arg_t>)> func,
+                                    size_t grain = 0,
+                                    thread_pool& pool = thread_pool::global())
+    {
+        auto out = std::vector<ret_t>();
+
+        auto got = object.find_pair(key_value);
+        if (got == nullptr)
+            return out;
+
+        auto got_cast = dynamic_cast<const tree_array *>(got->value().get());
+        if (got_cast == nullptr) {
+            std::cerr << "found key, but not an array\n";
+            std::cerr << "  looking for a tree_array, got a " << typeid(*got->value()).name() << "\n";
+            abort();
+        }
+
+        /* Each result gets an option of its own to be written into, as
+         * neighbouring elements of a std::vector<bool> can't safely be
+         * written from different threads. */
+        const auto& children = got_cast->children();
+        auto results = std::vector<option<ret_t>>(children.size());
+        pool.run(children.size(), grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                auto child_cast = std::dynamic_pointer_cast<arg_t>(children[i]);
+                if (child_cast == nullptr) {
+                    std::cerr << "found child, but not of argument type\n";
+                    std::cerr << "  looking for a " << typeid(arg_t).name() << ", got a " << typeid(*children[i]).name() << "\n";
+                    abort();
+                }
+
+                results[i] = option<ret_t>(func(child_cast));
+            }
+        });
+
+        out.reserve(results.size());
+        for (const auto& r: results)
+            out.push_back(r.data());
+        return out;
+    }
+}
+
+#endif
@@ -18,267 +18,638 @@
  */
 
 #include "parser.h++"
+#include "compression.h++"
 #include "lexer.h++"
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdlib>
+#include <iterator>
 #include <iostream>
 #include <map>
-#include <stack>
+#include <mutex>
+#include <thread>
 using namespace pson;
 
+/* What an open array or object is expecting to see next. */
 enum state {
-    TOP,
-    DONE,
-    ARRAY,
-    EAT_COMMAS,
+    ARRAY_FIRST,
+    ARRAY_VALUE,
+    ARRAY_COMMA,
+    OBJECT_FIRST,
     OBJECT_KEY,
+    OBJECT_COLON,
     OBJECT_VALUE,
+    OBJECT_COMMA,
 };
 
-static
-std::shared_ptr<tree> parse(const std::vector<std::string>::const_iterator start,
-                            const std::vector<std::string>::const_iterator stop,
-                            bool json_strict);
+/* Allocates a new tree node, keeping track of how long that took. */
+template<typename T, typename... A>
+static inline std::shared_ptr<T> build(stats *s, memory_resource *mr, A&&... args);
+
+typedef tree_pair<std::shared_ptr<tree>, std::shared_ptr<tree>> simple_pair;
 
 static inline std::string to_string(const enum state& s) __attribute__((unused));
 
-static inline option<int> to_int(const std::string& token);
+static inline option<int> to_int(const lexer::token& token);
+
+/* Reads a file on a separate thread and lexes it as it arrives, then
+ * parses the result. */
+static std::shared_ptr<tree> parse_file_overlapped(const std::string& filename,
+                                                   bool json_strict);
 
 std::shared_ptr<tree> pson::parse_json_file(const std::string& filename)
 {
-    auto tokens = lexer::lex_file(filename);
-    return parse(tokens.begin(), tokens.end(), true);
+    return parse_context().parse_json_file(filename);
 }
 
 std::shared_ptr<tree> pson::parse_pson_file(const std::string& filename)
 {
-    auto tokens = lexer::lex_file(filename);
-    return parse(tokens.begin(), tokens.end(), false);
+    return parse_context().parse_pson_file(filename);
+}
+
+std::shared_ptr<tree> pson::parse_json_string(const std::string& data)
+{
+    return parse_context().parse_json_string(data);
+}
+
+std::shared_ptr<tree> pson::parse_pson_string(const std::string& data)
+{
+    return parse_context().parse_pson_string(data);
+}
+
+std::shared_ptr<tree> pson::parse_json_file(const std::string& filename, stats& s)
+{
+    return parse_context().parse_json_file(filename, s);
+}
+
+std::shared_ptr<tree> pson::parse_pson_file(const std::string& filename, stats& s)
+{
+    return parse_context().parse_pson_file(filename, s);
+}
+
+std::shared_ptr<tree> pson::parse_json_string(const std::string& data, stats& s)
+{
+    return parse_context().parse_json_string(data, s);
+}
+
+std::shared_ptr<tree> pson::parse_pson_string(const std::string& data, stats& s)
+{
+    return parse_context().parse_pson_string(data, s);
+}
+
+std::shared_ptr<tree> pson::parse_json_file(const std::string& filename, memory_resource *mr)
+{
+    return parse_context(mr).parse_json_file(filename);
+}
+
+std::shared_ptr<tree> pson::parse_pson_file(const std::string& filename, memory_resource *mr)
+{
+    return parse_context(mr).parse_pson_file(filename);
+}
+
+std::shared_ptr<tree> pson::parse_json_string(const std::string& data, memory_resource *mr)
+{
+    return parse_context(mr).parse_json_string(data);
+}
+
+std::shared_ptr<tree> pson::parse_pson_string(const std::string& data, memory_resource *mr)
+{
+    return parse_context(mr).parse_pson_string(data);
+}
+
+std::future<std::shared_ptr<tree>> pson::parse_json_file_async(const std::string& filename)
+{
+    return std::async(std::launch::async, parse_file_overlapped, filename, true);
+}
+
+std::future<std::shared_ptr<tree>> pson::parse_pson_file_async(const std::string& filename)
+{
+    return std::async(std::launch::async, parse_file_overlapped, filename, false);
+}
+
+/* What sort of elements an array has seen so far.  Arrays start out
+ * collecting plain values, in the hope they'll end up packed, and only get a
+ * node per element once something else shows up. */
+enum packing {
+    PACK_EMPTY,
+    PACK_INTS,
+    PACK_STRINGS,
+    PACK_NONE,
+};
+
+/* The parser keeps one of these for every array or object that's currently
+ * open, which is all the state there is: parsing doesn't recurse.  They're
+ * kept around between parses so their storage gets reused. */
+struct parse_context::frame {
+    enum state state;
+    enum packing packing;
+    std::vector<std::shared_ptr<tree>, allocator<std::shared_ptr<tree>>> elements;
+    std::vector<std::shared_ptr<tree_pair_t>, allocator<std::shared_ptr<tree_pair_t>>> pairs;
+    std::vector<int, allocator<int>> ints;
+    std::vector<std::string, allocator<std::string>> strings;
+    std::shared_ptr<tree> key;
+
+    frame(memory_resource *mr)
+    : state(state::ARRAY_FIRST),
+      packing(PACK_EMPTY),
+      elements(allocator<std::shared_ptr<tree>>(mr)),
+      pairs(allocator<std::shared_ptr<tree_pair_t>>(mr)),
+      ints(allocator<int>(mr)),
+      strings(allocator<std::string>(mr)),
+      key(nullptr)
+    {}
+
+    void clear(void)
+    {
+        packing = PACK_EMPTY;
+        elements.clear();
+        pairs.clear();
+        ints.clear();
+        strings.clear();
+        key = nullptr;
+    }
+};
+
+parse_context::parse_context(memory_resource *mr)
+: _mr(mr == nullptr ? new_delete_resource() : mr),
+  _max_depth(default_max_depth),
+  _pack_threshold(default_pack_threshold),
+  _buffer(),
+  _tokens(allocator<lexer::token>(_mr)),
+  _frames()
+{
+}
+
+parse_context::~parse_context(void)
+{
+}
+
+std::shared_ptr<tree> parse_context::parse_json_file(const std::string& filename)
+{
+    return parse_data(read_file(filename, nullptr), true, nullptr);
+}
+
+std::shared_ptr<tree> parse_context::parse_pson_file(const std::string& filename)
+{
+    return parse_data(read_file(filename, nullptr), false, nullptr);
+}
+
+std::shared_ptr<tree> parse_context::parse_json_string(const std::string& data)
+{
+    return parse_data(data, true, nullptr);
+}
+
+std::shared_ptr<tree> parse_context::parse_pson_string(const std::string& data)
+{
+    return parse_data(data, false, nullptr);
+}
+
+std::shared_ptr<tree> parse_context::parse_json_file(const std::string& filename, stats& s)
+{
+    return parse_data(read_file(filename, &s), true, &s);
+}
+
+std::shared_ptr<tree> parse_context::parse_pson_file(const std::string& filename, stats& s)
+{
+    return parse_data(read_file(filename, &s), false, &s);
+}
+
+std::shared_ptr<tree> parse_context::parse_json_string(const std::string& data, stats& s)
+{
+    return parse_data(data, true, &s);
+}
+
+std::shared_ptr<tree> parse_context::parse_pson_string(const std::string& data, stats& s)
+{
+    return parse_data(data, false, &s);
+}
+
+std::shared_ptr<tree> parse_context::parse_json_tokens(const lexer::token_list::const_iterator start,
+                                                       const lexer::token_list::const_iterator stop)
+{
+    return parse(start, stop, true, nullptr);
 }
 
-std::shared_ptr<tree> pson::parse_json_string(const std::string& filename)
+std::shared_ptr<tree> parse_context::parse_pson_tokens(const lexer::token_list::const_iterator start,
+                                                       const lexer::token_list::const_iterator stop)
 {
-    auto tokens = lexer::lex_string(filename);
-    return parse(tokens.begin(), tokens.end(), true);
+    return parse(start, stop, false, nullptr);
 }
 
-std::shared_ptr<tree> pson::parse_pson_string(const std::string& filename)
+const std::string& parse_context::read_file(const std::string& filename, stats *s)
 {
-    auto tokens = lexer::lex_string(filename);
-    return parse(tokens.begin(), tokens.end(), false);
+    instrument::timer t(s, &stats::read_seconds);
+
+    _buffer.clear();
+    compressed_ifstream file(filename);
+    if (!file)
+        return _buffer;
+
+    /* Uncompressed regular files can be read in one go, as their size is
+     * known up front.  Anything else (a pipe, say, or a compressed file)
+     * needs to be read until it runs out. */
+    size_t used = 0;
+    if (file.format() == compression::NONE && file.file_size() > 0)
+        _buffer.resize(file.file_size() + 1);
+    else
+        _buffer.resize(1 << 16);
+    while (true) {
+        file.read(&_buffer[used], _buffer.size() - used);
+        used += file.gcount();
+        if (used < _buffer.size())
+            break;
+        _buffer.resize(2 * _buffer.size());
+    }
+    _buffer.resize(used);
+
+    /* The start of a damaged file might well parse on its own, so none of
+     * it is used. */
+    if (file.bad())
+        _buffer.clear();
+
+    return _buffer;
 }
 
-std::shared_ptr<tree> parse(const std::vector<std::string>::const_iterator start,
-                            const std::vector<std::string>::const_iterator stop,
-                            bool json_strict)
+std::shared_ptr<tree> parse_context::parse_data(const std::string& data,
+                                                bool json_strict,
+                                                stats *s)
 {
-    std::stack<state> state_stack;
-    state_stack.push(state::TOP);
+    instrument::add(s, &stats::bytes_read, data.size());
+
+    size_t count;
+    {
+        instrument::timer t(s, &stats::lex_seconds);
+        count = lexer::lex_string(data, _tokens);
+    }
+    instrument::add(s, &stats::tokens, count);
+
+    instrument::timer t(s, &stats::parse_seconds);
+    return parse(_tokens.begin(), _tokens.begin() + count, json_strict, s);
+}
 
+std::shared_ptr<tree> parse_context::parse(const lexer::token_list::const_iterator start,
+                                           const lexer::token_list::const_iterator stop,
+                                           bool json_strict,
+                                           stats *s)
+{
     std::shared_ptr<tree> out = nullptr;
+    size_t open = 0;
+
+    /* Drops every open frame's references to a partially built tree. */
+    auto unwind = [&]() {
+        for (size_t i = 0; i < open; ++i)
+            _frames[i]->clear();
+    };
+
+    /* Gives every plain value an array has collected a node of its own,
+     * after which it's an ordinary array. */
+    auto unpack = [&](frame& f) {
+        for (const auto& i: f.ints)
+            f.elements.push_back(build<tree_element<int>>(s, _mr, i));
+        for (const auto& str: f.strings)
+            f.elements.push_back(build<tree_element<std::string>>(s, _mr, str));
+        f.ints.clear();
+        f.strings.clear();
+        f.packing = PACK_NONE;
+    };
+
+    /* Hands a finished value to whatever encloses it. */
+    auto deliver = [&](const std::shared_ptr<tree>& value) {
+        if (open == 0) {
+            out = value;
+            return;
+        }
 
-    size_t child_opens = 0;
-    std::vector<std::string>::const_iterator child_start;
-    std::vector<std::shared_ptr<tree>> child_elements;
-    std::vector<std::shared_ptr<tree_pair_t>> child_pairs;
-    std::shared_ptr<tree> child_key;
+        auto& f = *_frames[open - 1];
+        switch (f.state) {
+        case state::ARRAY_FIRST:
+        case state::ARRAY_VALUE:
+            if (f.packing != PACK_NONE)
+                unpack(f);
+            f.elements.push_back(value);
+            f.state = state::ARRAY_COMMA;
+            break;
 
-    for (auto it = start; it < stop; ++it) {
-        auto token = *it;
-
-        switch (state_stack.top()) {
-        case state::TOP:
-            if (token[0] == '"') {
-                if (token[token.size() - 1] != '"') {
-                    std::cerr << "Malformed string: no trailing \"\n";
-                    abort();
-                }
-                auto stripped = token.substr(1, token.size() - 2);
-                out = std::make_shared<tree_element<std::string>>(stripped);
-                state_stack.push(state::DONE);
-            } else if (token == "null") {
-                out = std::make_shared<tree_null>();
-                state_stack.push(state::DONE);
-            } else if (token == "[") {
-                state_stack.push(state::ARRAY);
-                child_elements = {};
-                child_start = it + 1;
-                child_opens = 1;
-            } else if (token == "{") {
-                state_stack.push(state::OBJECT_KEY);
-                child_pairs = {};
-                child_start = it + 1;
-                child_opens = 1;
-            } else if (to_int(token).valid()) {
-                out = std::make_shared<tree_element<int>>(to_int(token).data());
-                state_stack.push(state::DONE);
-            } else {
-                std::cerr << "Unparsable token " << token << "\n";
+        case state::OBJECT_FIRST:
+        case state::OBJECT_KEY:
+            f.key = value;
+            f.state = state::OBJECT_COLON;
+            break;
+
+        case state::OBJECT_VALUE:
+            f.pairs.push_back(build<simple_pair>(s, _mr, f.key, value));
+            f.key = nullptr;
+            f.state = state::OBJECT_COMMA;
+            break;
+
+        case state::ARRAY_COMMA:
+        case state::OBJECT_COLON:
+        case state::OBJECT_COMMA:
+            std::cerr << "Value in unexpected place\n";
+            abort();
+        }
+    };
+
+    /* Finishes off the innermost open array or object. */
+    auto close = [&](const lexer::token& token) {
+        auto& f = *_frames[open - 1];
+        std::shared_ptr<tree> node;
+
+        switch (f.state) {
+        case state::ARRAY_FIRST:
+        case state::ARRAY_VALUE:
+        case state::ARRAY_COMMA:
+            if (token != "]") {
+                std::cerr << "Arrays must end with ]\n";
                 abort();
             }
+            if (f.packing == PACK_INTS && _pack_threshold > 0 && f.ints.size() >= _pack_threshold) {
+                instrument::add(s, &stats::allocations, 1);
+                node = build<tree_packed_array<int>>(s, _mr, f.ints.begin(), f.ints.end());
+                break;
+            }
+            if (f.packing == PACK_STRINGS && _pack_threshold > 0 && f.strings.size() >= _pack_threshold) {
+                instrument::add(s, &stats::allocations, 1);
+                node = build<tree_packed_array<std::string>>(s, _mr,
+                                                             std::make_move_iterator(f.strings.begin()),
+                                                             std::make_move_iterator(f.strings.end()));
+                break;
+            }
+            if (f.packing != PACK_NONE)
+                unpack(f);
+            if (f.elements.size() > 0)
+                instrument::add(s, &stats::allocations, 1);
+            node = build<tree_array>(s, _mr, f.elements.begin(), f.elements.end());
             break;
 
-        case state::DONE:
-            if ((json_strict == false) && (token == ",")) {
-                /* We explicitly allow extra trailing commas when not parsing
-                 * JSON in strict mode. */
-            } else {
-                std::cerr << "Extra token after JSON file: " << token << "\n";
+        case state::OBJECT_FIRST:
+        case state::OBJECT_KEY:
+        case state::OBJECT_COMMA:
+            if (token != "}") {
+                std::cerr << "Objects must end with }\n";
                 abort();
             }
+            if (f.pairs.size() > 0)
+                instrument::add(s, &stats::allocations, 1);
+            node = build<tree_object>(s, _mr, f.pairs.begin(), f.pairs.end());
             break;
 
-        case state::ARRAY:
-            if (token == "{" || token == "[")
-                child_opens++;
-            if (token == "}" || token == "]")
-                child_opens--;
-
-            if (child_opens == 1 && token == ",") {
-                auto element = parse(child_start, it, json_strict);
-                if (element == nullptr) {
-                    std::cerr << "Unable to parse array element, array is:\n";
-                    for (auto itt = start; itt < stop; ++itt)
-                        std::cerr << "  token: " << *itt << "\n";
-                    std::cerr << std::endl;
-                    return nullptr;
-                }
+        case state::OBJECT_COLON:
+        case state::OBJECT_VALUE:
+            std::cerr << "Object key without value\n";
+            abort();
+        }
 
-                child_elements.push_back(element);
-                state_stack.push(state::EAT_COMMAS);
+        f.clear();
+        open--;
+        deliver(node);
+    };
+
+    /* Starts a new value: either a scalar, or a new array or object.
+     * Returns false when that would nest too deeply. */
+    auto value = [&](const lexer::token& token) {
+        if (token == "[" || token == "{") {
+            if (open >= _max_depth) {
+                std::cerr << "Exceeded maximum nesting depth of " << _max_depth << "\n";
+                return false;
             }
 
-            if (child_opens == 0) {
-                if (child_start <= it-1) {
-                    auto element = parse(child_start, it, json_strict);
-                    if (element == nullptr) {
-                        std::cerr << "Unable to parse last array element\n";
-                        abort();
-                    }
-                    child_elements.push_back(element);
-                }
-                
-                if (token != "]") {
-                    std::cerr << "Arrays must end with ]\n";
-                    abort();
-                }
-
-                out = std::make_shared<tree_array>(child_elements);
-                state_stack.push(state::DONE);
+            if (_frames.size() <= open)
+                _frames.push_back(std::make_unique<frame>(_mr));
+            _frames[open]->state = (token == "[") ? state::ARRAY_FIRST : state::OBJECT_FIRST;
+            _frames[open]->packing = (token == "[") ? PACK_EMPTY : PACK_NONE;
+            open++;
+            instrument::peak(s, &stats::peak_depth, open);
+            return true;
+        }
+
+        /* Scalars going into an array that could still be packed are just
+         * collected up, without building a node. */
+        auto packable = (open > 0) ? _frames[open - 1].get() : nullptr;
+        if (packable != nullptr && (packable->packing == PACK_NONE ||
+                                    (packable->state != state::ARRAY_FIRST &&
+                                     packable->state != state::ARRAY_VALUE)))
+            packable = nullptr;
+
+        if (token[0] == '"') {
+            if (token.size() < 2 || token[token.size() - 1] != '"') {
+                std::cerr << "Malformed string: no trailing \"\n";
+                abort();
             }
-            break;
+            auto stripped = std::string(token.begin() + 1, token.end() - 1);
+            if (packable != nullptr && packable->packing != PACK_INTS) {
+                packable->strings.push_back(std::move(stripped));
+                packable->packing = PACK_STRINGS;
+                packable->state = state::ARRAY_COMMA;
+                return true;
+            }
+            deliver(build<tree_element<std::string>>(s, _mr, stripped));
+        } else if (token == "null") {
+            deliver(build<tree_null>(s, _mr));
+        } else if (to_int(token).valid()) {
+            auto i = to_int(token).data();
+            if (packable != nullptr && packable->packing != PACK_STRINGS) {
+                packable->ints.push_back(i);
+                packable->packing = PACK_INTS;
+                packable->state = state::ARRAY_COMMA;
+                return true;
+            }
+            deliver(build<tree_element<int>>(s, _mr, i));
+        } else {
+            std::cerr << "Unparsable token " << token << "\n";
+            abort();
+        }
+        return true;
+    };
 
-        case state::EAT_COMMAS:
-            child_start = it;
-            /* This is funky, but essentially here we want to go ahead and
-             * re-parse any braces.  Since we know EAT_COMMAS can't
-             * enter an opening brace there's no reason to bother doing
-             * anything like counting the opening braces. */
-            if (token == "{" || token == "[")
-                it--;
-            if (token == "]" || token == "}")
-                it--;
-            if (token != ",")
-                state_stack.pop();
-            break;
+    for (auto it = start; it < stop; ++it) {
+        const auto& token = *it;
 
-        case state::OBJECT_KEY:
-            if (token == "{" || token == "[")
-                child_opens++;
-            if (token == "}" || token == "]")
-                child_opens--;
-
-            if (child_opens == 1 && token == ":") {
-                child_key = parse(child_start, it, json_strict);
-                if (child_key == nullptr) {
-                    std::cerr << "Unable to parse object key\n";
-                    abort();
-                }
-                child_start = it + 1;
-
-                state_stack.push(state::OBJECT_VALUE);
+        if (open == 0) {
+            if (out == nullptr) {
+                if (!value(token))
+                    return nullptr;
+            } else if ((json_strict == false) && (token == ",")) {
+                /* We explicitly allow extra trailing commas when not parsing
+                 * JSON in strict mode. */
+            } else {
+                std::cerr << "Extra token after JSON file: " << token << "\n";
+                abort();
             }
+            continue;
+        }
 
-            if (child_opens == 0) {
-                out = std::make_shared<tree_object>(child_pairs);
-                state_stack.push(state::DONE);
-            }
+        /* Inside arrays and objects commas can be repeated, and can trail
+         * the last element (even in strict mode). */
+        auto& f = *_frames[open - 1];
+        auto ok = true;
+        switch (f.state) {
+        case state::ARRAY_FIRST:
+        case state::OBJECT_FIRST:
+            if (token == "]" || token == "}")
+                close(token);
+            else
+                ok = value(token);
             break;
 
+        case state::ARRAY_VALUE:
+        case state::OBJECT_KEY:
+            if (token == "]" || token == "}")
+                close(token);
+            else if (token != ",")
+                ok = value(token);
+            break;
 
         case state::OBJECT_VALUE:
-            if (token == "{" || token == "[")
-                child_opens++;
-            if (token == "}" || token == "]")
-                child_opens--;
-
-            if (child_opens == 1 && token == ",") {
-                auto child_value = parse(child_start, it, json_strict);
-                if (child_value == nullptr) {
-                    std::cerr << "Unable to parse object value\n";
-                    abort();
-                }
-                if (child_key == nullptr) {
-                    std::cerr << "Object value without key\n";
-                    abort();
-                }
-
-                child_pairs.push_back(make_tree_pair(child_key, child_value));
-                child_key = nullptr;
-                state_stack.pop();
-                state_stack.push(state::EAT_COMMAS);
+            ok = value(token);
+            break;
+
+        case state::ARRAY_COMMA:
+        case state::OBJECT_COMMA:
+            if (token == ",") {
+                f.state = (f.state == state::ARRAY_COMMA) ? state::ARRAY_VALUE : state::OBJECT_KEY;
+            } else if (token == "]" || token == "}") {
+                close(token);
+            } else {
+                std::cerr << "Missing comma before " << token << "\n";
+                abort();
             }
+            break;
 
-            if (child_opens == 0) {
-                auto child_value = parse(child_start, it, json_strict);
-                if (child_value == nullptr) {
-                    std::cerr << "Unable to parse object value\n";
-                    abort();
-                }
-                if (child_key == nullptr) {
-                    std::cerr << "Object value without key\n";
-                    abort();
-                }
-
-                child_pairs.push_back(make_tree_pair(child_key, child_value));
-                child_key = nullptr;
-                state_stack.pop();
-                state_stack.push(state::EAT_COMMAS);
-
-                out = std::make_shared<tree_object>(child_pairs);
-                state_stack.push(state::DONE);
+        case state::OBJECT_COLON:
+            if (token != ":") {
+                std::cerr << "Missing : after object key\n";
+                abort();
             }
+            f.state = state::OBJECT_VALUE;
             break;
         }
+
+        if (!ok) {
+            unwind();
+            return nullptr;
+        }
     }
 
-    if (out == nullptr) {
+    if (open > 0 || out == nullptr) {
         std::cerr << "Unable to parse tokens:" << std::endl;
         for (auto it = start; it < stop; ++it)
             std::cerr << "  token: " << *it << "\n";
         std::cerr << std::endl;
+        unwind();
+        return nullptr;
     }
+
     return out;
 }
 
+template<typename T, typename... A>
+std::shared_ptr<T> build(stats *s, memory_resource *mr, A&&... args)
+{
+    instrument::timer t(s, &stats::tree_build_seconds);
+    instrument::add(s, &stats::nodes, 1);
+    instrument::add(s, &stats::allocations, 1);
+    return std::allocate_shared<T>(allocator<T>(mr), std::forward<A>(args)...);
+}
+
 std::string to_string(const enum state& s)
 {
     switch (s) {
-    case state::TOP: return "TOP";
-    case state::DONE: return "DONE";
-    case state::ARRAY: return "ARRAY";
-    case state::EAT_COMMAS: return "EAT_COMMAS";
+    case state::ARRAY_FIRST: return "ARRAY_FIRST";
+    case state::ARRAY_VALUE: return "ARRAY_VALUE";
+    case state::ARRAY_COMMA: return "ARRAY_COMMA";
+    case state::OBJECT_FIRST: return "OBJECT_FIRST";
     case state::OBJECT_KEY: return "OBJECT_KEY";
+    case state::OBJECT_COLON: return "OBJECT_COLON";
     case state::OBJECT_VALUE: return "OBJECT_VALUE";
+    case state::OBJECT_COMMA: return "OBJECT_COMMA";
     }
 
     abort();
     return "";
 }
 
-inline option<int> to_int(const std::string& token)
+inline option<int> to_int(const lexer::token& token)
 {
-    try {
-        return option<int>(std::stoi(token));
-    } catch (...) {
+    /* This matches std::stoi(), but works on tokens that don't live in a
+     * std::string. */
+    char *end;
+    errno = 0;
+    auto value = strtol(token.c_str(), &end, 10);
+    if (end == token.c_str() || errno == ERANGE || value < INT_MIN || value > INT_MAX)
         return option<int>();
+    return option<int>(value);
+}
+
+std::shared_ptr<tree> parse_file_overlapped(const std::string& filename,
+                                            bool json_strict)
+{
+    /* Chunks are handed from the reader to the lexer through "full", and
+     * then handed back through "empty" so their buffers get reused.  Only
+     * a handful are ever in flight, which bounds how far ahead of the
+     * lexer the reader can get. */
+    const size_t chunk_size = 1 << 16;
+    const size_t chunk_count = 4;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::string> full, empty(chunk_count);
+    bool done = false;
+
+    bool damaged = false;
+    std::thread reader([&](){
+        compressed_ifstream file(filename);
+        while (file) {
+            std::string chunk;
+            {
+                std::unique_lock<std::mutex> l(lock);
+                changed.wait(l, [&](){ return empty.size() > 0; });
+                chunk.swap(empty.back());
+                empty.pop_back();
+            }
+
+            chunk.resize(chunk_size);
+            file.read(&chunk[0], chunk.size());
+            chunk.resize(file.gcount());
+
+            std::unique_lock<std::mutex> l(lock);
+            full.insert(full.begin(), std::move(chunk));
+            changed.notify_all();
+        }
+
+        std::unique_lock<std::mutex> l(lock);
+        damaged = file.bad();
+        done = true;
+        changed.notify_all();
+    });
+
+    lexer::token_list tokens;
+    lexer::chunked_lexer lexer(tokens);
+    while (true) {
+        std::string chunk;
+        {
+            std::unique_lock<std::mutex> l(lock);
+            changed.wait(l, [&](){ return full.size() > 0 || done; });
+            if (full.size() == 0)
+                break;
+            chunk.swap(full.back());
+            full.pop_back();
+        }
+
+        lexer.feed(chunk);
+
+        std::unique_lock<std::mutex> l(lock);
+        empty.push_back(std::move(chunk));
+        changed.notify_all();
     }
+    reader.join();
+    if (damaged)
+        return nullptr;
+
+    auto count = lexer.finish();
+    parse_context context;
+    if (json_strict)
+        return context.parse_json_tokens(tokens.begin(), tokens.begin() + count);
+    else
+        return context.parse_pson_tokens(tokens.begin(), tokens.begin() + count);
 }
@@ -20,9 +20,14 @@
 #ifndef LIBPSON__PARSER_HXX
 #define LIBPSON__PARSER_HXX
 
+#include "lexer.h++"
+#include "memory.h++"
+#include "stats.h++"
 #include "tree.h++"
+#include <future>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace pson {
     /* A JSON parser. */
@@ -33,6 +38,99 @@ namespace pson {
      * PSON files, but PSON allows trailing commas anywhere. */
     std::shared_ptr<tree> parse_pson_string(const std::string& filename);
     std::shared_ptr<tree> parse_pson_file(const std::string& data);
+
+    /* These are the same as above, but also record where the time went into
+     * the provided stats. */
+    std::shared_ptr<tree> parse_json_file(const std::string& filename, stats& s);
+    std::shared_ptr<tree> parse_json_string(const std::string& data, stats& s);
+    std::shared_ptr<tree> parse_pson_string(const std::string& data, stats& s);
+    std::shared_ptr<tree> parse_pson_file(const std::string& filename, stats& s);
+
+    /* These parse using memory from the given resource for the tokens, the
+     * parser's scratch space, and the tree nodes themselves.  The resource
+     * must outlive every node of the returned tree. */
+    std::shared_ptr<tree> parse_json_file(const std::string& filename, memory_resource *mr);
+    std::shared_ptr<tree> parse_json_string(const std::string& data, memory_resource *mr);
+    std::shared_ptr<tree> parse_pson_string(const std::string& data, memory_resource *mr);
+    std::shared_ptr<tree> parse_pson_file(const std::string& filename, memory_resource *mr);
+
+    /* These parse a file on a background thread, which itself reads the file
+     * on yet another thread in chunks and lexes each chunk as soon as it
+     * shows up, so waiting on a slow disk overlaps with lexing.  The future
+     * holds nullptr if the file couldn't be parsed. */
+    std::future<std::shared_ptr<tree>> parse_json_file_async(const std::string& filename);
+    std::future<std::shared_ptr<tree>> parse_pson_file_async(const std::string& filename);
+
+    /* Every parse needs a token list, a read buffer, and some scratch space
+     * for each level of nesting.  A parse_context holds on to all of those
+     * between parses so a caller that parses lots of small documents only
+     * pays for setting them up once.  Contexts aren't thread safe, so the
+     * usual pattern is one per thread.  Everything is allocated from the
+     * given resource, which must outlive both the context and any trees it
+     * produces.
+     *
+     * The parser doesn't recurse, it keeps an explicit stack with one entry
+     * per open array or object.  Documents nested more deeply than
+     * max_depth() are rejected: parsing them returns nullptr.
+     *
+     * Arrays of at least pack_threshold() integers, or of at least that many
+     * strings, come out as a tree_packed_array rather than as a node per
+     * element.  A threshold of 0 turns that off. */
+    class parse_context {
+    public:
+        static const size_t default_max_depth = 1024;
+        static const size_t default_pack_threshold = 16;
+
+    private:
+        struct frame;
+
+    private:
+        memory_resource *_mr;
+        size_t _max_depth;
+        size_t _pack_threshold;
+        std::string _buffer;
+        lexer::token_list _tokens;
+        std::vector<std::unique_ptr<frame>> _frames;
+
+    public:
+        parse_context(memory_resource *mr = nullptr);
+        parse_context(const parse_context&) = delete;
+        ~parse_context(void);
+
+    public:
+        size_t max_depth(void) const { return _max_depth; }
+        void set_max_depth(size_t max_depth) { _max_depth = max_depth; }
+        size_t pack_threshold(void) const { return _pack_threshold; }
+        void set_pack_threshold(size_t pack_threshold) { _pack_threshold = pack_threshold; }
+
+    public:
+        std::shared_ptr<tree> parse_json_file(const std::string& filename);
+        std::shared_ptr<tree> parse_json_string(const std::string& data);
+        std::shared_ptr<tree> parse_pson_string(const std::string& data);
+        std::shared_ptr<tree> parse_pson_file(const std::string& filename);
+
+        std::shared_ptr<tree> parse_json_file(const std::string& filename, stats& s);
+        std::shared_ptr<tree> parse_json_string(const std::string& data, stats& s);
+        std::shared_ptr<tree> parse_pson_string(const std::string& data, stats& s);
+        std::shared_ptr<tree> parse_pson_file(const std::string& filename, stats& s);
+
+        /* Parses tokens that have already been lexed, for callers that do
+         * their own lexing (with a lexer::chunked_lexer, for example). */
+        std::shared_ptr<tree> parse_json_tokens(const lexer::token_list::const_iterator start,
+                                                const lexer::token_list::const_iterator stop);
+        std::shared_ptr<tree> parse_pson_tokens(const lexer::token_list::const_iterator start,
+                                                const lexer::token_list::const_iterator stop);
+
+    private:
+        const std::string& read_file(const std::string& filename, stats *s);
+        std::shared_ptr<tree> parse_data(const std::string& data,
+                                         bool json_strict,
+                                         stats *s);
+        std::shared_ptr<tree> parse(const lexer::token_list::const_iterator start,
+                                    const lexer::token_list::const_iterator stop,
+                                    bool json_strict,
+                                    stats *s);
+    };
 }
 
 #endif
@@ -0,0 +1,125 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "push_parser.h++"
+#include "validate.h++"
+using namespace pson;
+
+push_parser::push_parser(bool json_strict, memory_resource *mr)
+: _json_strict(json_strict),
+  _context(mr),
+  _tokens(allocator<lexer::token>(mr)),
+  _lexer(_tokens),
+  _scanned(0),
+  _depth(0),
+  _start(0),
+  _ready()
+{
+}
+
+void push_parser::feed(const char *data, size_t size)
+{
+    _lexer.feed(data, size);
+    scan(_lexer.size());
+}
+
+void push_parser::finish(void)
+{
+    scan(_lexer.finish());
+
+    /* Whatever's left is an unterminated value, which the parser will
+     * refuse. */
+    if (_start < _scanned)
+        complete(_scanned);
+    _depth = 0;
+}
+
+std::shared_ptr<tree> push_parser::next(void)
+{
+    if (_ready.size() == 0)
+        return nullptr;
+
+    auto out = _ready.front();
+    _ready.pop_front();
+    return out;
+}
+
+void push_parser::scan(size_t count)
+{
+    /* Values are found by watching the nesting depth go back to zero, the
+     * real parsing is left to the parser once a value is complete. */
+    for (; _scanned < count; ++_scanned) {
+        const auto& token = _tokens[_scanned];
+        switch (token[0]) {
+        case '[':
+        case '{':
+            _depth++;
+            break;
+
+        case ']':
+        case '}':
+            if (_depth > 0)
+                _depth--;
+            if (_depth == 0)
+                complete(_scanned + 1);
+            break;
+
+        case ',':
+            if (_depth == 0 && _start == _scanned)
+                _start++;
+            break;
+
+        default:
+            if (_depth == 0)
+                complete(_scanned + 1);
+            break;
+        }
+    }
+
+    /* Tokens from values that have already been handed out can go. */
+    if (_start > 0) {
+        _lexer.discard(_start);
+        _scanned -= _start;
+        _start = 0;
+    }
+}
+
+/* The parser aborts on tokens it can't make sense of, which would let one
+ * bad message from a peer take down the whole process, so every value is
+ * validated before the parser gets to see it. */
+void push_parser::complete(size_t stop)
+{
+    auto start = _tokens.cbegin() + _start;
+    auto end = _tokens.cbegin() + stop;
+
+    validator v(_json_strict, _context.max_depth());
+    for (auto it = start; it != end && !v.failed(); ++it)
+        v.feed_token(it->data(), it->size());
+    if (!v.finish()) {
+        _ready.push_back(nullptr);
+        _start = stop;
+        return;
+    }
+
+    if (_json_strict)
+        _ready.push_back(_context.parse_json_tokens(start, end));
+    else
+        _ready.push_back(_context.parse_pson_tokens(start, end));
+    _start = stop;
+}
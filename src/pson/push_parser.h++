@@ -0,0 +1,89 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__PUSH_PARSER_HXX
+#define LIBPSON__PUSH_PARSER_HXX
+
+#include "lexer.h++"
+#include "memory.h++"
+#include "parser.h++"
+#include "tree.h++"
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace pson {
+    /* A parser that's handed its input a piece at a time, as it arrives off
+     * a socket or a pipe, rather than needing the whole thing up front.
+     * The input is a sequence of values (commas between them are allowed,
+     * but not required), and each one becomes available as soon as its last
+     * byte has been fed in.  Only the tokens of the value currently being
+     * parsed are kept around, so memory use is bounded by the largest single
+     * value rather than the whole stream.
+     *
+     * Values that fail to parse come out as nullptr, and parsing carries
+     * on with whatever comes after them: malformed input is never fatal. */
+    class push_parser {
+    private:
+        const bool _json_strict;
+        parse_context _context;
+        lexer::token_list _tokens;
+        lexer::chunked_lexer _lexer;
+
+        /* How many tokens have been looked at, how deeply nested the last
+         * of them was, and where the current value started. */
+        size_t _scanned;
+        size_t _depth;
+        size_t _start;
+
+        std::deque<std::shared_ptr<tree>> _ready;
+
+    public:
+        /* Parses strict JSON when json_strict is set, and PSON
+         * otherwise. */
+        push_parser(bool json_strict = false, memory_resource *mr = nullptr);
+        push_parser(const push_parser&) = delete;
+
+    public:
+        void feed(const char *data, size_t size);
+        void feed(const std::string& data) { feed(data.data(), data.size()); }
+
+        /* Signals the end of the input.  A value that's only terminated by
+         * the end of the input (a bare number, for example) doesn't become
+         * available until this is called, and a value that's still open is
+         * reported as a parse failure. */
+        void finish(void);
+
+        /* Returns TRUE when there's a complete value ready. */
+        bool available(void) const { return _ready.size() > 0; }
+
+        /* Hands out the oldest complete value. */
+        std::shared_ptr<tree> next(void);
+
+        /* The context used to parse each value, which is where the nesting
+         * limit can be adjusted. */
+        parse_context& context(void) { return _context; }
+
+    private:
+        void scan(size_t count);
+        void complete(size_t stop);
+    };
+}
+
+#endif
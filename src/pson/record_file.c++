@@ -0,0 +1,441 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "record_file.h++"
+#include "compression.h++"
+#include "parser.h++"
+#include "validate.h++"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+using namespace pson;
+
+static size_t value_end(const char *data, size_t pos, size_t size);
+static bool ends_scalar(char c);
+static void put(std::string& out, uint64_t value);
+static bool get(std::istream& in, uint64_t& value);
+
+/* Saved indices start with this, so something else that happens to have
+ * the sidecar's name isn't mistaken for one. */
+static const char magic[8] = {'P', 'S', 'O', 'N', 'I', 'D', 'X', '2'};
+
+/* How much of the start and of the end of the indexed data goes into the
+ * check that a saved index still matches. */
+static const size_t check_bytes = 4096;
+
+record_index::record_index(void)
+: _bounds(),
+  _scanned(0),
+  _check(check(nullptr, 0)),
+  _tail(false)
+{
+}
+
+size_t record_index::scan(const char *data, size_t size)
+{
+    auto before = this->size();
+
+    /* A scalar that ran to the end of the data last time might have had
+     * more of it appended since, so it's found all over again. */
+    if (_tail) {
+        _bounds.resize(_bounds.size() - 2);
+        _tail = false;
+    }
+
+    size_t pos = _scanned;
+    while (pos < size) {
+        /* Values are separated by whitespace, commas, or both.  Carriage
+         * returns are skipped here as well, so files with DOS line endings
+         * index just fine. */
+        auto c = data[pos];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',') {
+            pos++;
+            continue;
+        }
+
+        auto end = value_end(data, pos, size);
+        if (end == 0) {
+            if (c != '[' && c != '{' && c != '"') {
+                _bounds.push_back(pos);
+                _bounds.push_back(size);
+                _tail = true;
+            }
+            break;
+        }
+
+        _bounds.push_back(pos);
+        _bounds.push_back(end);
+        pos = end;
+        _scanned = end;
+    }
+
+    _check = check(data, _scanned);
+    return this->size() - before;
+}
+
+void record_index::clear(void)
+{
+    _bounds.clear();
+    _scanned = 0;
+    _check = check(nullptr, 0);
+    _tail = false;
+}
+
+bool record_index::save(const std::string& filename, const file_identity& from) const
+{
+    /* A scalar at the end isn't saved, as it might not be finished. */
+    auto count = size() - (_tail ? 1 : 0);
+
+    std::string out(magic, sizeof(magic));
+    put(out, from.inode);
+    put(out, from.size);
+    put(out, from.mtime_seconds);
+    put(out, from.mtime_nanoseconds);
+    put(out, _scanned);
+    put(out, _check);
+    put(out, count);
+    for (size_t i = 0; i < 2 * count; ++i)
+        put(out, _bounds[i]);
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(out.data(), out.size());
+    return bool(file);
+}
+
+bool record_index::load(const std::string& filename, const file_identity& from, const char *data, size_t size)
+{
+    clear();
+
+    std::ifstream file(filename, std::ios::binary);
+    char header[sizeof(magic)];
+    if (!file.read(header, sizeof(header)) || !std::equal(header, header + sizeof(header), magic))
+        return false;
+
+    uint64_t inode, saved_size, mtime_seconds, mtime_nanoseconds;
+    if (!get(file, inode) || !get(file, saved_size) || !get(file, mtime_seconds) || !get(file, mtime_nanoseconds))
+        return false;
+    if (inode != from.inode || saved_size > from.size)
+        return false;
+    if (saved_size == from.size && ((int64_t)mtime_seconds != from.mtime_seconds || (int64_t)mtime_nanoseconds != from.mtime_nanoseconds))
+        return false;
+
+    uint64_t scanned, stored, count;
+    if (!get(file, scanned) || !get(file, stored) || !get(file, count))
+        return false;
+    if (scanned > size || scanned > saved_size || count > scanned || check(data, scanned) != stored)
+        return false;
+
+    /* The check only covers the ends of the data, so make sure that every
+     * record still starts and ends on the bytes of a value.  The count
+     * can't be trusted until the bounds have actually been read, so they
+     * aren't allocated up front, and the sidecar has to end right after
+     * the last of them. */
+    std::vector<uint64_t> bounds;
+    uint64_t last = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t begin, end;
+        if (!get(file, begin) || !get(file, end))
+            return false;
+        if (begin < last || end > scanned || !value_at(data, size, begin, end))
+            return false;
+        bounds.push_back(begin);
+        bounds.push_back(end);
+        last = end;
+    }
+    if (file.peek() != std::ifstream::traits_type::eof())
+        return false;
+
+    _bounds.swap(bounds);
+    _scanned = scanned;
+    _check = stored;
+    return true;
+}
+
+/* An FNV-1a hash of the start and the end of the data, which is enough to
+ * notice a file that's been replaced rather than appended to without
+ * reading the whole thing. */
+uint64_t record_index::check(const char *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&](size_t first, size_t last) {
+        for (auto i = first; i < last; ++i)
+            hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    };
+
+    mix(0, std::min(size, check_bytes));
+    mix(size - std::min(size, check_bytes), size);
+    return hash ^ size;
+}
+
+/* Whether a value could start at begin and end just before end.  This
+ * only looks at the bytes on either side, not what's in between. */
+bool record_index::value_at(const char *data, size_t size, uint64_t begin, uint64_t end)
+{
+    if (begin >= end || end > size)
+        return false;
+
+    auto first = data[begin];
+    auto last = data[end - 1];
+    switch (first) {
+    case '[':
+    case '{':
+        return end - begin >= 2 && (last == ']' || last == '}');
+
+    case '"':
+        return end - begin >= 2 && last == '"';
+
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+    case ',':
+        return false;
+
+    case ']':
+    case '}':
+    case ':':
+        return end - begin == 1;
+    }
+
+    /* Scalars that were saved always had something after them to end
+     * them, and can't have run into one of those things either. */
+    return end < size && ends_scalar(data[end]) && !ends_scalar(last);
+}
+
+record_file::record_file(const std::string& filename, bool json_strict)
+: _filename(filename),
+  _json_strict(json_strict),
+  _fd(open(filename.c_str(), O_RDONLY)),
+  _data(nullptr),
+  _size(0),
+  _identity(),
+  _index()
+{
+    if (_fd < 0 || !map())
+        return;
+
+    /* Compressed files can't be read from just anywhere, so there's no
+     * point indexing them. */
+    if (detect_compression(_data, _size) != compression::NONE) {
+        std::cerr << filename << ": compressed files can't be indexed\n";
+        unmap();
+        close(_fd);
+        _fd = -1;
+        return;
+    }
+
+    _index.load(sidecar(filename), _identity, _data, _size);
+    _index.scan(_data, _size);
+}
+
+record_file::~record_file(void)
+{
+    unmap();
+    if (_fd >= 0)
+        close(_fd);
+}
+
+std::string record_file::text(size_t record) const
+{
+    if (record >= _index.size())
+        return "";
+
+    return std::string(_data + _index.begin(record), _data + _index.end(record));
+}
+
+std::shared_ptr<tree> record_file::parse(size_t record) const
+{
+    if (record >= _index.size())
+        return nullptr;
+
+    /* The parser aborts on input it can't make sense of, and one bad
+     * record shouldn't take the rest of the file down with it. */
+    auto t = text(record);
+    auto v = _json_strict ? validate_json_string(t) : validate_pson_string(t);
+    if (!v) {
+        std::cerr << _filename << ": record " << record << ":" << v.line << ":" << v.column << ": " << v.message << "\n";
+        return nullptr;
+    }
+
+    return _json_strict ? parse_json_string(t) : parse_pson_string(t);
+}
+
+std::vector<std::shared_ptr<tree>> record_file::parse(size_t first, size_t count) const
+{
+    std::vector<std::shared_ptr<tree>> out;
+    for (auto i = first; i < _index.size() && i - first < count; ++i)
+        out.push_back(parse(i));
+    return out;
+}
+
+size_t record_file::refresh(void)
+{
+    if (_fd < 0)
+        return 0;
+
+    unmap();
+    if (!map()) {
+        _index.clear();
+        return 0;
+    }
+
+    /* A file that's shrunk has been rewritten rather than appended to, so
+     * the old index is no use at all. */
+    if (_size < _index.scanned())
+        _index.clear();
+    return _index.scan(_data, _size);
+}
+
+bool record_file::map(void)
+{
+    if (!stat_file(_fd, _identity))
+        return false;
+
+    _size = _identity.size;
+    if (_size == 0)
+        return true;
+
+    auto p = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (p == MAP_FAILED) {
+        _size = 0;
+        return false;
+    }
+
+    _data = static_cast<const char *>(p);
+    return true;
+}
+
+void record_file::unmap(void)
+{
+    if (_data != nullptr)
+        munmap(const_cast<char *>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+}
+
+/* Finds the end of the value starting at pos, or returns 0 if it doesn't
+ * end before the data does.  This follows the lexer's rules for strings
+ * and escapes, so brackets inside strings aren't counted. */
+size_t value_end(const char *data, size_t pos, size_t size)
+{
+    auto c = data[pos];
+    if (c == '[' || c == '{') {
+        size_t depth = 0;
+        bool string = false;
+        for (; pos < size; ++pos) {
+            c = data[pos];
+            if (c == '\\') {
+                pos++;
+                continue;
+            }
+
+            if (string) {
+                if (c == '"')
+                    string = false;
+                continue;
+            }
+
+            switch (c) {
+            case '"':
+                string = true;
+                break;
+
+            case '[':
+            case '{':
+                depth++;
+                break;
+
+            case ']':
+            case '}':
+                if (--depth == 0)
+                    return pos + 1;
+                break;
+            }
+        }
+        return 0;
+    }
+
+    if (c == '"') {
+        for (pos++; pos < size; ++pos) {
+            if (data[pos] == '\\')
+                pos++;
+            else if (data[pos] == '"')
+                return pos + 1;
+        }
+        return 0;
+    }
+
+    /* Anything else is a scalar, which runs until the next separator.  A
+     * stray bit of punctuation is a value of its own, so that it's
+     * reported when the record is parsed. */
+    auto start = pos;
+    for (; pos < size; ++pos) {
+        c = data[pos];
+        if (c == '\\') {
+            pos++;
+            continue;
+        }
+
+        if (ends_scalar(c))
+            return (pos == start) ? pos + 1 : pos;
+    }
+    return 0;
+}
+
+bool ends_scalar(char c)
+{
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+    case ',':
+    case '[':
+    case ']':
+    case '{':
+    case '}':
+    case ':':
+    case '"':
+        return true;
+    }
+    return false;
+}
+
+/* Saved indices are little-endian, whatever the machine is. */
+void put(std::string& out, uint64_t value)
+{
+    for (size_t i = 0; i < 8; ++i)
+        out.push_back((char)(value >> (8 * i)));
+}
+
+bool get(std::istream& in, uint64_t& value)
+{
+    unsigned char bytes[8];
+    if (!in.read(reinterpret_cast<char *>(bytes), sizeof(bytes)))
+        return false;
+
+    value = 0;
+    for (size_t i = 0; i < 8; ++i)
+        value |= uint64_t(bytes[i]) << (8 * i);
+    return true;
+}
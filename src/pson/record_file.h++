@@ -0,0 +1,146 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__RECORD_FILE_HXX
+#define LIBPSON__RECORD_FILE_HXX
+
+#include "file_identity.h++"
+#include "tree.h++"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pson {
+    /* Where each top-level value of a file of many values starts and ends.
+     * These files are a sequence of values separated by whitespace or
+     * commas (NDJSON is one, with a record per line), which the parser
+     * can't deal with directly as it only accepts a single top-level
+     * value.  Values aren't checked while being indexed, that only
+     * happens once they're parsed.
+     *
+     * Indexing is incremental: a file that's only ever appended to can have
+     * just the new part scanned, and a value that's still being written
+     * (one that runs right up to the end of the data without finishing)
+     * isn't indexed until it's complete.  The exception is a scalar, which
+     * has nothing to finish it other than the end of the data: one that
+     * runs to the end is indexed, but is looked at again by the next scan
+     * in case more of it has been appended since.  Indices can be saved to
+     * and loaded from a sidecar file, so that opening a big file doesn't
+     * mean scanning the whole thing again. */
+    class record_index {
+    private:
+        std::vector<uint64_t> _bounds;
+        uint64_t _scanned;
+        uint64_t _check;
+        bool _tail;
+
+    public:
+        record_index(void);
+
+    public:
+        size_t size(void) const { return _bounds.size() / 2; }
+        uint64_t begin(size_t record) const { return _bounds[2 * record]; }
+        uint64_t end(size_t record) const { return _bounds[2 * record + 1]; }
+
+        /* Everything before this offset has been indexed, other than a
+         * scalar at the very end. */
+        uint64_t scanned(void) const { return _scanned; }
+
+        /* Indexes the data past scanned(), which must be the same data as
+         * was scanned before with more appended to it.  Returns the number
+         * of new records. */
+        size_t scan(const char *data, size_t size);
+
+        void clear(void);
+
+        /* Saved indices remember the inode, size and modification time of
+         * the file they were made from.  Loading checks that the saved
+         * index was made from this same file
+         * and matches the start of the given data, and that every record
+         * in it still starts and ends where a value could.  It returns
+         * FALSE (and leaves this index empty) if any of that fails, or if
+         * the file isn't a saved index at all.  A file that's the same
+         * size as when it was saved has to have the same modification time
+         * too, so that values edited in place are noticed; one that's
+         * grown can only be checked by its contents. */
+        bool save(const std::string& filename, const file_identity& from) const;
+        bool load(const std::string& filename, const file_identity& from, const char *data, size_t size);
+
+    private:
+        static uint64_t check(const char *data, size_t size);
+        static bool value_at(const char *data, size_t size, uint64_t begin, uint64_t end);
+    };
+
+    /* A file of many values, mapped into memory and indexed so that any one
+     * of them can be parsed without touching the others.  Opening the file
+     * picks up its sidecar index if there's a usable one, and scans
+     * whatever that doesn't cover.  Nothing is ever written unless
+     * save_index() is called.
+     *
+     * Parsing is thread safe, but refresh() must not run at the same time
+     * as anything else. */
+    class record_file {
+    private:
+        const std::string _filename;
+        const bool _json_strict;
+        int _fd;
+        const char *_data;
+        size_t _size;
+        file_identity _identity;
+        record_index _index;
+
+    public:
+        record_file(const std::string& filename, bool json_strict = false);
+        record_file(const record_file&) = delete;
+        ~record_file(void);
+
+        /* Where the index for a file is saved. */
+        static std::string sidecar(const std::string& filename) { return filename + ".idx"; }
+
+    public:
+        /* FALSE when the file couldn't be opened or is compressed, in
+         * which case there are no records. */
+        bool valid(void) const { return _fd >= 0; }
+
+        size_t size(void) const { return _index.size(); }
+        const record_index& index(void) const { return _index; }
+
+        /* The text of a single record, or the record parsed into a tree.
+         * Out-of-range records come back empty, or as nullptr.  Records
+         * are validated before they're parsed, so a malformed one is
+         * reported on stderr and comes back as nullptr too, rather than
+         * aborting like the parser would. */
+        std::string text(size_t record) const;
+        std::shared_ptr<tree> parse(size_t record) const;
+        std::vector<std::shared_ptr<tree>> parse(size_t first, size_t count) const;
+
+        /* Picks up any records that have been appended to the file since
+         * it was opened, returning how many there were. */
+        size_t refresh(void);
+
+        bool save_index(void) const { return _index.save(sidecar(_filename), _identity); }
+
+    private:
+        bool map(void);
+        void unmap(void);
+    };
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "shared_document.h++"
+#include "compression.h++"
+#include "parser.h++"
+#include "validate.h++"
+#include <iostream>
+#include <vector>
+using namespace pson;
+
+shared_document::shared_document(const std::shared_ptr<tree>& root)
+: _root(root),
+  _version(0)
+{
+}
+
+void shared_document::publish(const std::shared_ptr<tree>& root)
+{
+    /* The version is bumped after the store, so a reader that sees the new
+     * version is guaranteed to see the new root as well. */
+    std::atomic_store(&_root, root);
+    _version.fetch_add(1, std::memory_order_release);
+}
+
+bool shared_document::reload_json_file(const std::string& filename)
+{
+    return reload(filename, true);
+}
+
+bool shared_document::reload_pson_file(const std::string& filename)
+{
+    return reload(filename, false);
+}
+
+/* The parser aborts on input it can't handle, which is the last thing a
+ * server that's reloading its config should do, so the file is read once
+ * and validated before the parser ever sees it. */
+bool shared_document::reload(const std::string& filename, bool json_strict)
+{
+    compressed_ifstream file(filename);
+    if (!file) {
+        std::cerr << "Unable to open " << filename << "\n";
+        return false;
+    }
+
+    std::string data;
+    std::vector<char> chunk(1 << 16);
+    while (file) {
+        file.read(chunk.data(), chunk.size());
+        data.append(chunk.data(), file.gcount());
+    }
+    if (file.bad()) {
+        std::cerr << "Unable to read " << filename << "\n";
+        return false;
+    }
+
+    auto v = json_strict ? validate_json_string(data) : validate_pson_string(data);
+    if (!v) {
+        std::cerr << filename << ":" << v.line << ":" << v.column << ": " << v.message << "\n";
+        return false;
+    }
+
+    auto root = json_strict ? parse_json_string(data) : parse_pson_string(data);
+    if (root == nullptr)
+        return false;
+
+    publish(root);
+    return true;
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__SHARED_DOCUMENT_HXX
+#define LIBPSON__SHARED_DOCUMENT_HXX
+
+#include "tree.h++"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace pson {
+    /* Holds the current version of a document that's read by many threads
+     * and occasionally replaced, like a config file that gets reloaded
+     * while a server is running.  Readers never block on a writer: a writer
+     * parses the new version on its own time and then swaps it in with a
+     * single atomic store, while readers that grabbed the old version keep
+     * it alive until they let go of it. */
+    class shared_document {
+    private:
+        std::shared_ptr<tree> _root;
+        std::atomic<uint64_t> _version;
+
+    public:
+        shared_document(const std::shared_ptr<tree>& root = nullptr);
+        shared_document(const shared_document&) = delete;
+
+    public:
+        /* The current version of the document.  The returned tree stays
+         * valid for as long as the caller holds onto it, no matter how many
+         * times the document gets replaced in the meantime. */
+        std::shared_ptr<tree> snapshot(void) const
+        { return std::atomic_load(&_root); }
+
+        /* Counts the number of times a new tree has been published. */
+        uint64_t version(void) const
+        { return _version.load(std::memory_order_acquire); }
+
+        /* Replaces the current version of the document. */
+        void publish(const std::shared_ptr<tree>& root);
+
+        /* Parses a new version of the document and publishes it.  The file
+         * is checked before anything is built, so if it can't be read or
+         * doesn't parse then the old version is left alone, what's wrong
+         * is printed out, and FALSE is returned. */
+        bool reload_json_file(const std::string& filename);
+        bool reload_pson_file(const std::string& filename);
+
+    private:
+        bool reload(const std::string& filename, bool json_strict);
+
+    public:
+        /* A per-thread handle that caches the last snapshot it took.  As
+         * long as nothing has been published since, get() is just an atomic
+         * load of the version number, so readers in a hot loop don't write
+         * to any memory that's shared with other threads.  Readers aren't
+         * thread safe themselves: each thread should have its own. */
+        class reader {
+        private:
+            /* The version is read before the snapshot is taken, just like
+             * get() does, so a publish() that lands in between leaves the
+             * reader with an old version number and a newer tree, which
+             * the next get() fixes, rather than the other way around. */
+            const shared_document *_document;
+            uint64_t _version;
+            std::shared_ptr<tree> _cached;
+
+        public:
+            reader(const shared_document& document)
+            : _document(&document),
+              _version(document.version()),
+              _cached(document.snapshot())
+            {}
+
+        public:
+            /* The returned pointer is valid until the next call to get() or
+             * until this reader is destroyed. */
+            const tree *get(void)
+            {
+                auto version = _document->version();
+                if (version != _version) {
+                    _cached = _document->snapshot();
+                    _version = version;
+                }
+                return _cached.get();
+            }
+
+            const std::shared_ptr<tree>& shared(void)
+            {
+                get();
+                return _cached;
+            }
+        };
+    };
+}
+
+#endif
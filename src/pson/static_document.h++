@@ -0,0 +1,708 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__STATIC_DOCUMENT_HXX
+#define LIBPSON__STATIC_DOCUMENT_HXX
+
+#include "option.h++"
+#include "tree.h++"
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pson {
+    /* PSON documents that are parsed by the compiler, for things like
+     * default configs that are embedded in a program as string literals:
+     *
+     *   static constexpr auto defaults = PSON_STATIC(R"({"port": 80,})");
+     *   static_assert(defaults.root().find("port").as_int() == 80, "");
+     *
+     * A static_document is a flat table of nodes plus the characters of
+     * its strings, sized exactly for the literal, so declared constexpr
+     * it ends up in the read-only data of the binary and costs nothing at
+     * all at startup.  Literals are accepted or rejected exactly as
+     * parse_pson_string() would, and a malformed one is a compile error
+     * (a call to static_parse_error(), whose argument says what's wrong)
+     * rather than an abort() when the program runs.
+     *
+     * Documents are read through static_value, which has the same
+     * accessors as the tree classes but never touches the heap.  to_tree()
+     * builds an ordinary tree out of one, for everything that wants a
+     * std::shared_ptr<tree>. */
+    enum class static_kind: unsigned char {
+        NUL,
+        INT,
+        STRING,
+        ARRAY,
+        OBJECT,
+    };
+
+    /* Nodes are stored in document order: an array is followed by its
+     * elements, and an object by its keys and values, alternating.  Every
+     * node knows where the nodes that are inside it end, which is how
+     * siblings are found. */
+    struct static_node {
+        static_kind kind = static_kind::NUL;
+        int value = 0;
+        size_t offset = 0;
+        size_t size = 0;
+        size_t end = 0;
+    };
+
+    /* Called while parsing a literal that turns out to be malformed.  It
+     * isn't constexpr, which is what makes that a compile error. */
+    inline void static_parse_error(const char *message)
+    {
+        std::cerr << message << "\n";
+        abort();
+    }
+
+    /* The lexer and parser, written so the compiler can run them.  Both
+     * follow the runtime ones step for step, so they agree on every
+     * input.  A parse without anywhere to put the nodes just counts them,
+     * which is how documents are sized. */
+    class static_parser {
+    public:
+        static const size_t max_depth = 1024;
+
+    private:
+        enum state: unsigned char {
+            ARRAY_FIRST,
+            ARRAY_VALUE,
+            ARRAY_COMMA,
+            OBJECT_FIRST,
+            OBJECT_KEY,
+            OBJECT_COLON,
+            OBJECT_VALUE,
+            OBJECT_COMMA,
+        };
+
+        /* A token is a range of the input, and its characters are what the
+         * lexer would have kept of that range: whitespace outside of
+         * strings and the backslashes of escapes are dropped. */
+        struct token {
+            size_t begin = 0;
+            size_t end = 0;
+            size_t size = 0;
+            char first = 0;
+            char last = 0;
+        };
+
+        class cursor {
+        private:
+            const char *_text;
+            size_t _pos;
+            size_t _end;
+            bool _string;
+            bool _escape;
+
+        public:
+            constexpr cursor(const char *text, const token& t)
+            : _text(text), _pos(t.begin), _end(t.end), _string(false), _escape(false)
+            {}
+
+            constexpr bool next(char& c)
+            {
+                while (_pos < _end) {
+                    auto x = _text[_pos++];
+                    if (_escape) {
+                        _escape = false;
+                        c = x;
+                        return true;
+                    }
+                    if (x == '\\') {
+                        _escape = true;
+                        continue;
+                    }
+                    if (!_string && (x == ' ' || x == '\t' || x == '\n'))
+                        continue;
+                    if (x == '"')
+                        _string = !_string;
+                    c = x;
+                    return true;
+                }
+                return false;
+            }
+        };
+
+    private:
+        const char *_text;
+        static_node *_nodes;
+        char *_chars;
+        size_t _node_count;
+        size_t _char_count;
+
+        /* FALSE when just counting, to size a document.  This is kept
+         * rather than worked out from _nodes, as comparing the address of
+         * a static against nullptr isn't a constant expression when
+         * building with -fsanitize=null. */
+        bool _filling;
+
+        size_t _open;
+        size_t _frames[max_depth];
+        state _states[max_depth];
+        bool _have_value;
+
+    public:
+        constexpr explicit static_parser(const char *text)
+        : _text(text), _nodes(nullptr), _chars(nullptr), _node_count(0), _char_count(0),
+          _filling(false), _open(0), _frames{}, _states{}, _have_value(false)
+        {}
+
+        constexpr static_parser(const char *text, static_node *nodes, char *chars)
+        : _text(text), _nodes(nodes), _chars(chars), _node_count(0), _char_count(0),
+          _filling(true), _open(0), _frames{}, _states{}, _have_value(false)
+        {}
+
+        constexpr size_t node_count(void) const { return _node_count; }
+        constexpr size_t char_count(void) const { return _char_count; }
+
+        /* Lexes the input exactly as lexer::lex_string() does, handing
+         * each token to the parser as soon as it's complete. */
+        constexpr void parse(size_t size)
+        {
+            token t;
+            bool started = false;
+            bool string = false;
+            bool escape = false;
+
+            for (size_t i = 0; i < size; ++i) {
+                auto c = _text[i];
+                if (escape) {
+                    escape = false;
+                    push(t, c, i);
+                    continue;
+                }
+
+                if (string) {
+                    if (c == '\\') {
+                        escape = true;
+                    } else if (c == '"') {
+                        string = false;
+                        push(t, c, i);
+                        emit(t, started);
+                    } else {
+                        push(t, c, i);
+                    }
+                    continue;
+                }
+
+                switch (c) {
+                case '\\':
+                    if (!started) {
+                        t.begin = i;
+                        started = true;
+                    }
+                    escape = true;
+                    break;
+
+                case '"':
+                    if (!started) {
+                        t.begin = i;
+                        started = true;
+                    }
+                    string = true;
+                    push(t, c, i);
+                    break;
+
+                case '[':
+                case ']':
+                case '{':
+                case '}':
+                case ',':
+                case ':':
+                    if (t.size > 0)
+                        emit(t, started);
+                    t = token();
+                    t.begin = i;
+                    push(t, c, i);
+                    emit(t, started);
+                    break;
+
+                case ' ':
+                case '\t':
+                case '\n':
+                    break;
+
+                default:
+                    if (!started) {
+                        t.begin = i;
+                        started = true;
+                    }
+                    push(t, c, i);
+                }
+            }
+
+            if (t.size > 0)
+                emit(t, started);
+            finish();
+        }
+
+    private:
+        constexpr static void push(token& t, char c, size_t i)
+        {
+            if (t.size == 0)
+                t.first = c;
+            t.last = c;
+            t.size++;
+            t.end = i + 1;
+        }
+
+        constexpr void emit(token& t, bool& started)
+        {
+            handle(t);
+            t = token();
+            started = false;
+        }
+
+        constexpr static bool is(const token& t, char c)
+        {
+            return t.size == 1 && t.first == c;
+        }
+
+        constexpr bool is_null(const token& t) const
+        {
+            if (t.size != 4)
+                return false;
+            cursor k(_text, t);
+            char c = 0;
+            const char *null = "null";
+            for (size_t i = 0; i < 4; ++i)
+                if (!k.next(c) || c != null[i])
+                    return false;
+            return true;
+        }
+
+        /* The same answer as the strtol() the parser uses, which skips
+         * leading whitespace and ignores anything after the digits. */
+        constexpr bool to_int(const token& t, int& out) const
+        {
+            cursor k(_text, t);
+            char c = 0;
+            bool more = k.next(c);
+            while (more && (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r'))
+                more = k.next(c);
+
+            bool negative = false;
+            if (more && (c == '+' || c == '-')) {
+                negative = (c == '-');
+                more = k.next(c);
+            }
+
+            long long value = 0;
+            bool digits = false;
+            bool overflow = false;
+            while (more && c >= '0' && c <= '9') {
+                digits = true;
+                if (!overflow)
+                    value = value * 10 + (c - '0');
+                if (value > (long long)INT_MAX + 1)
+                    overflow = true;
+                more = k.next(c);
+            }
+
+            if (negative)
+                value = -value;
+            if (!digits || overflow || value < INT_MIN || value > INT_MAX)
+                return false;
+            out = (int)value;
+            return true;
+        }
+
+        constexpr size_t add(static_kind kind)
+        {
+            if (_filling) {
+                _nodes[_node_count].kind = kind;
+                _nodes[_node_count].end = _node_count + 1;
+            }
+            return _node_count++;
+        }
+
+        constexpr void handle(const token& t)
+        {
+            if (_open == 0) {
+                if (!_have_value)
+                    value(t);
+                else if (!is(t, ','))
+                    static_parse_error("Extra token after PSON literal");
+                return;
+            }
+
+            auto& top = _states[_open - 1];
+            switch (top) {
+            case ARRAY_FIRST:
+            case OBJECT_FIRST:
+                if (is(t, ']') || is(t, '}'))
+                    close(t);
+                else
+                    value(t);
+                break;
+
+            case ARRAY_VALUE:
+            case OBJECT_KEY:
+                if (is(t, ']') || is(t, '}'))
+                    close(t);
+                else if (!is(t, ','))
+                    value(t);
+                break;
+
+            case OBJECT_VALUE:
+                value(t);
+                break;
+
+            case ARRAY_COMMA:
+            case OBJECT_COMMA:
+                if (is(t, ','))
+                    top = (top == ARRAY_COMMA) ? ARRAY_VALUE : OBJECT_KEY;
+                else if (is(t, ']') || is(t, '}'))
+                    close(t);
+                else
+                    static_parse_error("Missing comma in PSON literal");
+                break;
+
+            case OBJECT_COLON:
+                if (!is(t, ':'))
+                    static_parse_error("Missing : after object key in PSON literal");
+                top = OBJECT_VALUE;
+                break;
+            }
+        }
+
+        constexpr void value(const token& t)
+        {
+            if (is(t, '[') || is(t, '{')) {
+                if (_open >= max_depth)
+                    static_parse_error("Exceeded maximum nesting depth in PSON literal");
+                _frames[_open] = add(is(t, '[') ? static_kind::ARRAY : static_kind::OBJECT);
+                _states[_open] = is(t, '[') ? ARRAY_FIRST : OBJECT_FIRST;
+                _open++;
+                return;
+            }
+
+            int i = 0;
+            if (t.first == '"') {
+                if (t.size < 2 || t.last != '"')
+                    static_parse_error("Malformed string in PSON literal: no trailing \"");
+
+                /* Everything but the quotes at either end. */
+                auto n = add(static_kind::STRING);
+                cursor k(_text, t);
+                char c = 0;
+                k.next(c);
+                for (size_t j = 0; j < t.size - 2; ++j) {
+                    k.next(c);
+                    if (_filling)
+                        _chars[_char_count + j] = c;
+                }
+                if (_filling) {
+                    _nodes[n].offset = _char_count;
+                    _nodes[n].size = t.size - 2;
+                }
+                _char_count += t.size - 2;
+            } else if (is_null(t)) {
+                add(static_kind::NUL);
+            } else if (to_int(t, i)) {
+                auto n = add(static_kind::INT);
+                if (_filling)
+                    _nodes[n].value = i;
+            } else {
+                static_parse_error("Unparsable token in PSON literal");
+            }
+            deliver();
+        }
+
+        constexpr void close(const token& t)
+        {
+            switch (_states[_open - 1]) {
+            case ARRAY_FIRST:
+            case ARRAY_VALUE:
+            case ARRAY_COMMA:
+                if (!is(t, ']'))
+                    static_parse_error("Arrays must end with ] in PSON literal");
+                break;
+
+            case OBJECT_FIRST:
+            case OBJECT_KEY:
+            case OBJECT_COMMA:
+                if (!is(t, '}'))
+                    static_parse_error("Objects must end with } in PSON literal");
+                break;
+
+            case OBJECT_COLON:
+            case OBJECT_VALUE:
+                static_parse_error("Object key without value in PSON literal");
+            }
+
+            _open--;
+            if (_filling)
+                _nodes[_frames[_open]].end = _node_count;
+            deliver();
+        }
+
+        constexpr void deliver(void)
+        {
+            if (_open == 0) {
+                _have_value = true;
+                return;
+            }
+
+            auto& top = _states[_open - 1];
+            switch (top) {
+            case ARRAY_FIRST:
+            case ARRAY_VALUE:
+                top = ARRAY_COMMA;
+                break;
+
+            case OBJECT_FIRST:
+            case OBJECT_KEY:
+                top = OBJECT_COLON;
+                return;
+
+            case OBJECT_VALUE:
+                top = OBJECT_COMMA;
+                break;
+
+            case ARRAY_COMMA:
+            case OBJECT_COLON:
+            case OBJECT_COMMA:
+                return;
+            }
+
+            if (_filling)
+                _nodes[_frames[_open - 1]].size++;
+        }
+
+        constexpr void finish(void)
+        {
+            if (_open > 0 || !_have_value)
+                static_parse_error("Unable to parse PSON literal: it ends early");
+        }
+    };
+
+    /* How big a static_document has to be for a literal. */
+    template<size_t N> constexpr size_t static_nodes(const char (&text)[N])
+    {
+        static_parser p(text);
+        p.parse(N - 1);
+        return p.node_count();
+    }
+
+    template<size_t N> constexpr size_t static_chars(const char (&text)[N])
+    {
+        static_parser p(text);
+        p.parse(N - 1);
+        return p.char_count();
+    }
+
+    /* One value in a static_document.  These are small and cheap to copy,
+     * and are only valid as long as the document is (which, for one that's
+     * static, is forever).  A lookup that doesn't find anything returns a
+     * value for which exists() is FALSE. */
+    class static_value {
+    private:
+        const static_node *_nodes;
+        const char *_chars;
+        size_t _index;
+
+        /* Kept for the same reason as static_parser::_filling. */
+        bool _exists;
+
+    public:
+        constexpr static_value(const static_node *nodes, const char *chars, size_t index)
+        : _nodes(nodes), _chars(chars), _index(index), _exists(true)
+        {}
+
+    private:
+        constexpr static_value(void)
+        : _nodes(nullptr), _chars(nullptr), _index(0), _exists(false)
+        {}
+
+    public:
+        constexpr bool exists(void) const { return _exists; }
+        constexpr static_kind kind(void) const { return _nodes[_index].kind; }
+        constexpr bool is_null(void) const { return exists() && kind() == static_kind::NUL; }
+        constexpr bool is_int(void) const { return exists() && kind() == static_kind::INT; }
+        constexpr bool is_string(void) const { return exists() && kind() == static_kind::STRING; }
+        constexpr bool is_array(void) const { return exists() && kind() == static_kind::ARRAY; }
+        constexpr bool is_object(void) const { return exists() && kind() == static_kind::OBJECT; }
+
+        /* The number of elements of an array, pairs of an object, or
+         * characters of a string.  Values that don't exist are empty. */
+        constexpr size_t size(void) const { return exists() ? _nodes[_index].size : 0; }
+
+        constexpr int as_int(void) const { return _nodes[_index].value; }
+        constexpr const char *data(void) const { return _chars + _nodes[_index].offset; }
+        std::string as_string(void) const { return std::string(data(), size()); }
+
+        /* Elements of an array, and keys and values of an object.  Asking
+         * for one past the end, or of some other type of value, gives a
+         * value that doesn't exist. */
+        constexpr static_value at(size_t i) const
+        {
+            return (is_array() && i < size()) ? static_value(_nodes, _chars, nth(i)) : none();
+        }
+
+        constexpr static_value key(size_t i) const
+        {
+            return (is_object() && i < size()) ? static_value(_nodes, _chars, nth(2 * i)) : none();
+        }
+
+        constexpr static_value value(size_t i) const
+        {
+            return (is_object() && i < size()) ? static_value(_nodes, _chars, nth(2 * i + 1)) : none();
+        }
+
+        /* The value of the first pair with the given string key, which
+         * doesn't exist if this isn't an object. */
+        constexpr static_value find(const char *key_value) const
+        {
+            if (!is_object())
+                return none();
+
+            auto n = _index + 1;
+            for (size_t i = 0; i < size(); ++i) {
+                auto v = _nodes[n].end;
+                if (_nodes[n].kind == static_kind::STRING && matches(_nodes[n], key_value))
+                    return static_value(_nodes, _chars, v);
+                n = _nodes[v].end;
+            }
+            return none();
+        }
+
+        /* Just like tree_object::get(): missing keys give an empty option,
+         * and keys with some other type of value abort. */
+        template<typename T> constexpr option<T> get(const char *key_value) const
+        {
+            auto v = find(key_value);
+            if (!v.exists())
+                return option<T>();
+            return option<T>(v.template as<T>());
+        }
+
+        template<typename T> constexpr T as(void) const;
+
+        /* An ordinary tree with the same contents, built on the heap. */
+        std::shared_ptr<tree> to_tree(void) const
+        {
+            if (!exists())
+                return nullptr;
+
+            switch (kind()) {
+            case static_kind::NUL:
+                return std::make_shared<tree_null>();
+
+            case static_kind::INT:
+                return std::make_shared<tree_element<int>>(as_int());
+
+            case static_kind::STRING:
+                return std::make_shared<tree_element<std::string>>(as_string());
+
+            case static_kind::ARRAY: {
+                std::vector<std::shared_ptr<tree>> children;
+                for (size_t i = 0; i < size(); ++i)
+                    children.push_back(at(i).to_tree());
+                return std::make_shared<tree_array>(children);
+            }
+
+            case static_kind::OBJECT: {
+                std::vector<std::shared_ptr<tree_pair_t>> pairs;
+                for (size_t i = 0; i < size(); ++i)
+                    pairs.push_back(make_tree_pair(key(i).to_tree(), value(i).to_tree()));
+                return std::make_shared<tree_object>(pairs);
+            }
+            }
+
+            return nullptr;
+        }
+
+    private:
+        static constexpr static_value none(void) { return static_value(); }
+
+        /* The index of the ith node directly inside this one. */
+        constexpr size_t nth(size_t i) const
+        {
+            auto n = _index + 1;
+            for (size_t j = 0; j < i; ++j)
+                n = _nodes[n].end;
+            return n;
+        }
+
+        constexpr bool matches(const static_node& node, const char *key_value) const
+        {
+            for (size_t i = 0; i < node.size; ++i)
+                if (key_value[i] != _chars[node.offset + i])
+                    return false;
+            return key_value[node.size] == '\0';
+        }
+
+        void wrong_type(void) const
+        {
+            std::cerr << "found key with the wrong type\n";
+            abort();
+        }
+    };
+
+    template<> constexpr int static_value::as<int>(void) const
+    {
+        if (!is_int())
+            wrong_type();
+        return as_int();
+    }
+
+    template<> inline std::string static_value::as<std::string>(void) const
+    {
+        if (!is_string())
+            wrong_type();
+        return as_string();
+    }
+
+    template<size_t Nodes, size_t Chars>
+    class static_document {
+    private:
+        static_node _nodes[Nodes];
+
+        /* There's always at least one character, as arrays can't be
+         * empty. */
+        char _chars[Chars + 1];
+
+    public:
+        template<size_t N>
+        constexpr static_document(const char (&text)[N])
+        : _nodes{}, _chars{}
+        {
+            static_parser p(text, _nodes, _chars);
+            p.parse(N - 1);
+        }
+
+    public:
+        constexpr static_value root(void) const { return static_value(_nodes, _chars, 0); }
+        std::shared_ptr<tree> to_tree(void) const { return root().to_tree(); }
+    };
+}
+
+/* Parses a PSON string literal while compiling.  The result should be
+ * stored in a static constexpr variable, which is what guarantees it's
+ * parsed by the compiler rather than at startup. */
+#define PSON_STATIC(text) \
+    pson::static_document<pson::static_nodes(text), pson::static_chars(text)>(text)
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__STATS_HXX
+#define LIBPSON__STATS_HXX
+
+#include "writer.h++"
+#include <chrono>
+#include <cstddef>
+
+namespace pson {
+    /* Counters that describe where a parse or emit spent its time.  These
+     * only ever accumulate, so a single instance can follow a document all
+     * the way from being read to being written back out.  Building with
+     * PSON_DISABLE_STATS defined turns all the recording into no-ops. */
+    struct stats {
+        double read_seconds = 0;
+        double lex_seconds = 0;
+        double parse_seconds = 0;
+
+        /* The parser builds nodes as it recognizes them, so this is the
+         * part of parse_seconds spent constructing tree nodes. */
+        double tree_build_seconds = 0;
+        double emit_seconds = 0;
+
+        size_t bytes_read = 0;
+        size_t bytes_written = 0;
+        size_t tokens = 0;
+        size_t nodes = 0;
+        size_t peak_depth = 0;
+
+        /* Heap allocations made by the parser to store the tree: one for
+         * each node, and one for each non-empty list of children. */
+        size_t allocations = 0;
+    };
+
+    namespace instrument {
+#ifndef PSON_DISABLE_STATS
+        /* Adds the lifetime of this object to one of the timers in a stats,
+         * if there is one. */
+        class timer {
+        private:
+            double *_out;
+            std::chrono::steady_clock::time_point _start;
+
+        public:
+            timer(stats *s, double stats::*field)
+            : _out(s == nullptr ? nullptr : &(s->*field)),
+              _start(s == nullptr ? std::chrono::steady_clock::time_point()
+                                  : std::chrono::steady_clock::now())
+            {}
+
+            ~timer(void)
+            {
+                if (_out != nullptr) {
+                    auto stop = std::chrono::steady_clock::now();
+                    *_out += std::chrono::duration<double>(stop - _start).count();
+                }
+            }
+        };
+
+        static inline void add(stats *s, size_t stats::*field, size_t count)
+        {
+            if (s != nullptr)
+                s->*field += count;
+        }
+
+        static inline void peak(stats *s, size_t stats::*field, size_t value)
+        {
+            if (s != nullptr && s->*field < value)
+                s->*field = value;
+        }
+#else
+        class timer {
+        public:
+            timer(stats *s, double stats::*field) {}
+        };
+
+        static inline void add(stats *s, size_t stats::*field, size_t count) {}
+        static inline void peak(stats *s, size_t stats::*field, size_t value) {}
+#endif
+    }
+
+    template<> struct serializer<stats> {
+        static void write(writer& w, const stats& s) {
+            w.begin_object()
+                .field("read_seconds", s.read_seconds)
+                .field("lex_seconds", s.lex_seconds)
+                .field("parse_seconds", s.parse_seconds)
+                .field("tree_build_seconds", s.tree_build_seconds)
+                .field("emit_seconds", s.emit_seconds)
+                .field("bytes_read", s.bytes_read)
+                .field("bytes_written", s.bytes_written)
+                .field("tokens", s.tokens)
+                .field("nodes", s.nodes)
+                .field("peak_depth", s.peak_depth)
+                .field("allocations", s.allocations)
+                .end_object();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "thread_pool.h++"
+#include <algorithm>
+#include <exception>
+using namespace pson;
+
+/* One call to run(), which lives on the stack of the thread that made it.
+ * Everything here is guarded by the lock, including the count of pieces
+ * that haven't finished: whoever finishes the last piece signals while
+ * holding it, so once run() has seen the count hit zero with the lock held
+ * nobody else will touch the batch again. */
+struct thread_pool::batch {
+    const std::function<void(size_t, size_t)>& body;
+    size_t remaining;
+    std::exception_ptr error;
+    std::mutex lock;
+    std::condition_variable done;
+};
+
+thread_pool::thread_pool(size_t threads)
+: _queues(),
+  _workers(),
+  _lock(),
+  _wake(),
+  _queued(0),
+  _stop(false)
+{
+    for (size_t i = 1; i < threads; ++i)
+        _queues.push_back(std::make_unique<queue>());
+    for (size_t i = 1; i < threads; ++i)
+        _workers.push_back(std::thread([this, i]() { work(i - 1); }));
+}
+
+thread_pool::~thread_pool(void)
+{
+    {
+        std::unique_lock<std::mutex> l(_lock);
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for (auto& w: _workers)
+        w.join();
+}
+
+thread_pool& thread_pool::global(void)
+{
+    static thread_pool pool;
+    return pool;
+}
+
+void thread_pool::run(size_t count,
+                      size_t grain,
+                      const std::function<void(size_t begin, size_t end)>& body)
+{
+    if (count == 0)
+        return;
+
+    if (grain == 0)
+        grain = std::max<size_t>(1, count / (size() * 4));
+    auto pieces = (count + grain - 1) / grain;
+
+    if (_workers.size() == 0 || pieces == 1) {
+        for (size_t begin = 0; begin < count; begin += grain)
+            body(begin, std::min(begin + grain, count));
+        return;
+    }
+
+    /* Each worker starts out with a contiguous run of pieces, so neighbouring
+     * elements tend to be handled by the same thread. */
+    batch b{body, pieces, nullptr, {}, {}};
+    {
+        std::unique_lock<std::mutex> l(_lock);
+        _queued += pieces;
+        for (size_t p = 0; p < pieces; ++p) {
+            auto& q = *_queues[p * _queues.size() / pieces];
+            auto begin = p * grain;
+            std::unique_lock<std::mutex> ql(q.lock);
+            q.tasks.push_back(task{&b, begin, std::min(begin + grain, count)});
+        }
+    }
+    _wake.notify_all();
+
+    /* The calling thread steals work until there's none left anywhere, and
+     * then waits for the pieces that other threads are still working on. */
+    while (true) {
+        {
+            std::unique_lock<std::mutex> l(b.lock);
+            if (b.remaining == 0)
+                break;
+        }
+
+        task t;
+        if (take(_queues.size(), t)) {
+            execute(t);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> l(b.lock);
+        b.done.wait(l, [&]() { return b.remaining == 0; });
+        break;
+    }
+
+    if (b.error)
+        std::rethrow_exception(b.error);
+}
+
+void thread_pool::work(size_t self)
+{
+    while (true) {
+        task t;
+        if (take(self, t)) {
+            execute(t);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> l(_lock);
+        _wake.wait(l, [&]() { return _stop || _queued > 0; });
+        if (_stop && _queued == 0)
+            return;
+    }
+}
+
+/* Workers take from the front of their own queue, and steal from the back
+ * of everyone else's.  self is past the end for threads that aren't
+ * workers. */
+bool thread_pool::take(size_t self, task& out)
+{
+    for (size_t i = 0; i < _queues.size(); ++i) {
+        auto victim = (self + i) % _queues.size();
+        auto& q = *_queues[victim];
+        std::unique_lock<std::mutex> l(q.lock);
+        if (q.tasks.size() == 0)
+            continue;
+
+        if (victim == self) {
+            out = q.tasks.front();
+            q.tasks.pop_front();
+        } else {
+            out = q.tasks.back();
+            q.tasks.pop_back();
+        }
+        _queued--;
+        return true;
+    }
+
+    return false;
+}
+
+void thread_pool::execute(const task& t)
+{
+    auto& b = *t.owner;
+    std::exception_ptr error;
+    try {
+        b.body(t.begin, t.end);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> l(b.lock);
+    if (error && !b.error)
+        b.error = error;
+    if (--b.remaining == 0)
+        b.done.notify_all();
+}
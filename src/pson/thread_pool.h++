@@ -0,0 +1,101 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__THREAD_POOL_HXX
+#define LIBPSON__THREAD_POOL_HXX
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pson {
+    /* A fixed set of worker threads for splitting loops over big arrays.
+     * Each worker has its own queue of pieces of work, and a worker that
+     * runs out steals from the others, so an uneven split (some elements
+     * being much more expensive than others) still keeps every thread
+     * busy.  The thread that starts a loop works on it as well rather than
+     * just waiting, which also means loops can be started from inside
+     * other loops without deadlocking. */
+    class thread_pool {
+    private:
+        struct batch;
+        struct task {
+            batch *owner;
+            size_t begin;
+            size_t end;
+        };
+        struct queue {
+            std::mutex lock;
+            std::deque<task> tasks;
+        };
+
+    private:
+        std::vector<std::unique_ptr<queue>> _queues;
+        std::vector<std::thread> _workers;
+        std::mutex _lock;
+        std::condition_variable _wake;
+        std::atomic<size_t> _queued;
+        bool _stop;
+
+    public:
+        /* The calling thread counts as one of the threads, so a pool of a
+         * single thread doesn't start any workers at all. */
+        thread_pool(size_t threads = std::thread::hardware_concurrency());
+        thread_pool(const thread_pool&) = delete;
+        ~thread_pool(void);
+
+        /* A pool with a thread per core, shared by the whole process. */
+        static thread_pool& global(void);
+
+    public:
+        size_t size(void) const { return _workers.size() + 1; }
+
+        /* Calls body(begin, end) on pieces of [0, count) that are at most
+         * grain long, in parallel, and returns once they've all finished.
+         * A grain of 0 picks one that gives each thread a few pieces.  If
+         * any of the calls throws, the first exception is rethrown here
+         * once the rest have finished. */
+        void run(size_t count,
+                 size_t grain,
+                 const std::function<void(size_t begin, size_t end)>& body);
+
+    private:
+        void work(size_t self);
+        bool take(size_t self, task& out);
+        void execute(const task& t);
+    };
+
+    /* Calls func(i) for every i in [0, count) on the given pool. */
+    template<typename F>
+    void parallel_for(size_t count, F func, size_t grain = 0, thread_pool& pool = thread_pool::global())
+    {
+        pool.run(count, grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                func(i);
+        });
+    }
+}
+
+#endif
@@ -0,0 +1,331 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "transcoder.h++"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+using namespace pson;
+
+/* The same states the parser keeps for each open array or object. */
+enum class transcoder::state: unsigned char {
+    ARRAY_FIRST,
+    ARRAY_VALUE,
+    ARRAY_COMMA,
+    OBJECT_FIRST,
+    OBJECT_KEY,
+    OBJECT_COLON,
+    OBJECT_VALUE,
+    OBJECT_COMMA,
+};
+
+static bool transcode_file(const std::string& input,
+                           const std::string& output,
+                           writer::format format,
+                           compression compress,
+                           bool json_strict);
+
+/* Output is collected up and handed to the stream in big pieces, which is
+ * much cheaper than writing each token to it separately. */
+static const size_t buffer_size = 1 << 16;
+
+bool pson::transcode_json_file(const std::string& input,
+                               const std::string& output,
+                               writer::format format,
+                               compression compress)
+{
+    return transcode_file(input, output, format, compress, true);
+}
+
+bool pson::transcode_pson_file(const std::string& input,
+                               const std::string& output,
+                               writer::format format,
+                               compression compress)
+{
+    return transcode_file(input, output, format, compress, false);
+}
+
+transcoder::transcoder(std::ostream& out,
+                       writer::format format,
+                       bool json_strict,
+                       size_t max_depth)
+: _out(out),
+  _format(format),
+  _json_strict(json_strict),
+  _max_depth(max_depth),
+  _tokens(),
+  _lexer(_tokens),
+  _stack(),
+  _have_value(false),
+  _failed(false),
+  _buffer()
+{
+}
+
+bool transcoder::feed(const char *data, size_t size)
+{
+    if (_failed)
+        return false;
+
+    _lexer.feed(data, size);
+    auto count = _lexer.size();
+    for (size_t i = 0; i < count && !_failed; ++i)
+        token(_tokens[i]);
+    _lexer.discard(count);
+
+    if (_buffer.size() >= buffer_size)
+        flush();
+    return !_failed;
+}
+
+bool transcoder::finish(void)
+{
+    if (_failed)
+        return false;
+
+    auto count = _lexer.finish();
+    for (size_t i = 0; i < count && !_failed; ++i)
+        token(_tokens[i]);
+    _lexer.discard(count);
+
+    if (!_failed && (_stack.size() > 0 || !_have_value))
+        fail("Unable to parse tokens: input ended early");
+    if (_failed)
+        return false;
+
+    _buffer += "\n";
+    flush();
+    return true;
+}
+
+void transcoder::token(const lexer::token& token)
+{
+    if (_stack.size() == 0) {
+        if (!_have_value)
+            value(token);
+        else if (!_json_strict && token == ",")
+            {}
+        else
+            fail("Extra token after JSON file: " + std::string(token.begin(), token.end()));
+        return;
+    }
+
+    auto& top = _stack.back().first;
+    switch (top) {
+    case state::ARRAY_FIRST:
+    case state::OBJECT_FIRST:
+        if (token == "]" || token == "}")
+            close(token);
+        else
+            value(token);
+        break;
+
+    case state::ARRAY_VALUE:
+    case state::OBJECT_KEY:
+        if (token == "]" || token == "}")
+            close(token);
+        else if (token != ",")
+            value(token);
+        break;
+
+    case state::OBJECT_VALUE:
+        value(token);
+        break;
+
+    case state::ARRAY_COMMA:
+    case state::OBJECT_COMMA:
+        if (token == ",")
+            top = (top == state::ARRAY_COMMA) ? state::ARRAY_VALUE : state::OBJECT_KEY;
+        else if (token == "]" || token == "}")
+            close(token);
+        else
+            fail("Missing comma before " + std::string(token.begin(), token.end()));
+        break;
+
+    case state::OBJECT_COLON:
+        if (token != ":")
+            return fail("Missing : after object key");
+        top = state::OBJECT_VALUE;
+        _buffer += (_format == writer::format::PRETTY) ? ": " : ":";
+        break;
+    }
+}
+
+void transcoder::value(const lexer::token& token)
+{
+    if (token == "[" || token == "{") {
+        if (_stack.size() >= _max_depth)
+            return fail("Exceeded maximum nesting depth of " + std::to_string(_max_depth));
+
+        separate();
+        _buffer += token[0];
+        if (_format == writer::format::PRETTY)
+            _buffer += "\n";
+        _stack.push_back(std::make_pair(token == "[" ? state::ARRAY_FIRST : state::OBJECT_FIRST, 0));
+        return;
+    }
+
+    if (token[0] == '"') {
+        if (token.size() < 2 || token[token.size() - 1] != '"')
+            return fail("Malformed string: no trailing \"");
+        separate();
+        _buffer.append(token.data(), token.size());
+    } else if (token == "null") {
+        separate();
+        _buffer += "null";
+    } else {
+        /* This matches the std::stoi() the emitter's numbers went through,
+         * so things like leading zeros come out the same way. */
+        char *end;
+        errno = 0;
+        auto value = strtol(token.c_str(), &end, 10);
+        if (end == token.c_str() || errno == ERANGE || value < INT_MIN || value > INT_MAX)
+            return fail("Unparsable token " + std::string(token.begin(), token.end()));
+        separate();
+        _buffer += std::to_string(value);
+    }
+    deliver();
+}
+
+void transcoder::close(const lexer::token& token)
+{
+    auto top = _stack.back();
+    switch (top.first) {
+    case state::ARRAY_FIRST:
+    case state::ARRAY_VALUE:
+    case state::ARRAY_COMMA:
+        if (token != "]")
+            return fail("Arrays must end with ]");
+        break;
+
+    case state::OBJECT_FIRST:
+    case state::OBJECT_KEY:
+    case state::OBJECT_COMMA:
+        if (token != "}")
+            return fail("Objects must end with }");
+        break;
+
+    case state::OBJECT_COLON:
+    case state::OBJECT_VALUE:
+        return fail("Object key without value");
+    }
+
+    _stack.pop_back();
+    if (_format == writer::format::PRETTY) {
+        _buffer += "\n";
+        indent(_stack.size());
+    }
+    _buffer += token[0];
+    deliver();
+}
+
+/* Keeps track of what the innermost open array or object expects after a
+ * value has been written into it. */
+void transcoder::deliver(void)
+{
+    if (_stack.size() == 0) {
+        _have_value = true;
+        return;
+    }
+
+    auto& top = _stack.back().first;
+    switch (top) {
+    case state::ARRAY_FIRST:
+    case state::ARRAY_VALUE:
+        top = state::ARRAY_COMMA;
+        break;
+
+    case state::OBJECT_FIRST:
+    case state::OBJECT_KEY:
+        top = state::OBJECT_COLON;
+        break;
+
+    case state::OBJECT_VALUE:
+        top = state::OBJECT_COMMA;
+        break;
+
+    case state::ARRAY_COMMA:
+    case state::OBJECT_COLON:
+    case state::OBJECT_COMMA:
+        break;
+    }
+}
+
+/* Commas are only written once the next element shows up, which is what
+ * makes trailing commas disappear. */
+void transcoder::separate(void)
+{
+    if (_stack.size() == 0 || _stack.back().first == state::OBJECT_VALUE)
+        return;
+
+    auto& count = _stack.back().second;
+    if (count++ > 0)
+        _buffer += (_format == writer::format::PRETTY) ? ",\n" : ",";
+    if (_format == writer::format::PRETTY)
+        indent(_stack.size());
+}
+
+void transcoder::indent(size_t depth)
+{
+    for (size_t i = 0; i < depth; ++i)
+        _buffer += "  ";
+}
+
+void transcoder::fail(const std::string& message)
+{
+    std::cerr << message << "\n";
+    _failed = true;
+    flush();
+}
+
+void transcoder::flush(void)
+{
+    _out.write(_buffer.data(), _buffer.size());
+    _buffer.clear();
+}
+
+bool transcode_file(const std::string& input,
+                    const std::string& output,
+                    writer::format format,
+                    compression compress,
+                    bool json_strict)
+{
+    bool ok;
+    {
+        compressed_ifstream in(input);
+        compressed_ofstream out(output, compress);
+        transcoder t(out, format, json_strict);
+
+        std::vector<char> buffer(buffer_size);
+        while (in && !t.failed()) {
+            in.read(buffer.data(), buffer.size());
+            t.feed(buffer.data(), in.gcount());
+        }
+        ok = !in.bad() && t.finish();
+
+        out.close();
+        ok = ok && !out.fail();
+    }
+
+    if (!ok)
+        std::remove(output.c_str());
+    return ok;
+}
@@ -0,0 +1,103 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__TRANSCODER_HXX
+#define LIBPSON__TRANSCODER_HXX
+
+#include "compression.h++"
+#include "lexer.h++"
+#include "parser.h++"
+#include "writer.h++"
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace pson {
+    /* Converts PSON (or JSON) to JSON one token at a time, writing each
+     * token out as soon as it's been recognized rather than building a
+     * tree first.  Trailing commas are dropped and the output is either
+     * indented exactly the way emit_json() does it or has all the
+     * whitespace removed.  Memory use doesn't depend on the size of the
+     * input, just on how deeply it's nested.
+     *
+     * Input is accepted or rejected exactly as the parser would, but
+     * problems are reported on stderr rather than aborting.  Anything
+     * written before a problem was found has already been sent to the
+     * output. */
+    class transcoder {
+    private:
+        enum class state: unsigned char;
+
+    private:
+        std::ostream& _out;
+        const writer::format _format;
+        const bool _json_strict;
+        const size_t _max_depth;
+
+        lexer::token_list _tokens;
+        lexer::chunked_lexer _lexer;
+
+        /* The state of every open array or object, along with how many
+         * elements it's had written out so far. */
+        std::vector<std::pair<state, size_t>> _stack;
+        bool _have_value;
+        bool _failed;
+        std::string _buffer;
+
+    public:
+        transcoder(std::ostream& out,
+                   writer::format format = writer::format::PRETTY,
+                   bool json_strict = false,
+                   size_t max_depth = parse_context::default_max_depth);
+        transcoder(const transcoder&) = delete;
+
+    public:
+        /* Both of these return FALSE once the input has been found to be
+         * malformed. */
+        bool feed(const char *data, size_t size);
+        bool feed(const std::string& data) { return feed(data.data(), data.size()); }
+        bool finish(void);
+
+        bool failed(void) const { return _failed; }
+
+    private:
+        void token(const lexer::token& token);
+        void value(const lexer::token& token);
+        void close(const lexer::token& token);
+        void deliver(void);
+        void separate(void);
+        void indent(size_t depth);
+        void fail(const std::string& message);
+        void flush(void);
+    };
+
+    /* Converts a whole file.  If the input turns out to be malformed the
+     * partially written output is removed and FALSE is returned.  Input
+     * files can be compressed, and the output can be too. */
+    bool transcode_json_file(const std::string& input,
+                             const std::string& output,
+                             writer::format format = writer::format::PRETTY,
+                             compression compress = compression::NONE);
+    bool transcode_pson_file(const std::string& input,
+                             const std::string& output,
+                             writer::format format = writer::format::PRETTY,
+                             compression compress = compression::NONE);
+}
+
+#endif
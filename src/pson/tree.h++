@@ -21,8 +21,11 @@
 #define LIBPSON__TREE_HXX
 
 #include "option.h++"
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 namespace pson {
@@ -72,11 +75,75 @@ namespace pson {
         : _children(children)
         {}
 
+        template<typename I>
+        tree_array(I first, I last)
+        : _children(first, last)
+        {}
+
 	virtual ~tree_array(void) {}
 
+    protected:
+        /* For subclasses that store their children some other way. */
+        tree_array(void)
+        : _children()
+        {}
+
     public:
-        const std::vector<std::shared_ptr<tree>>& children(void) const { return _children; }
+        virtual const std::vector<std::shared_ptr<tree>>& children(void) const { return _children; }
         virtual const std::string debug(void) const { return "tree_array"; }
+
+    public:
+        /* Borrowed access to the children: the returned pointers live as
+         * long as this array does, and fetching them doesn't touch any
+         * reference counts, so many threads can walk a shared tree without
+         * fighting over cache lines. */
+        virtual size_t size(void) const { return _children.size(); }
+        virtual const tree *at(size_t i) const { return _children[i].get(); }
+    };
+
+    /* An array where every element is the same sort of scalar, stored as
+     * one contiguous buffer of values rather than a node per element.  The
+     * parser produces these for long enough arrays of integers or strings.
+     * values() and data() give direct access to the buffer, while
+     * children() and at() still work as they would for any other array:
+     * the first call builds a node for every element, once, which is
+     * safe to do from many threads. */
+    template<typename T>
+    class tree_packed_array: public tree_array {
+    private:
+        const std::vector<T> _values;
+        mutable std::once_flag _boxed_once;
+        mutable std::vector<std::shared_ptr<tree>> _boxed;
+
+    public:
+        template<typename I>
+        tree_packed_array(I first, I last)
+        : tree_array(),
+          _values(first, last),
+          _boxed_once(),
+          _boxed()
+        {}
+
+	virtual ~tree_packed_array(void) {}
+
+    public:
+        const std::vector<T>& values(void) const { return _values; }
+        const T *data(void) const { return _values.data(); }
+
+    public:
+        virtual const std::vector<std::shared_ptr<tree>>& children(void) const
+        {
+            std::call_once(_boxed_once, [this]() {
+                _boxed.reserve(_values.size());
+                for (const auto& v: _values)
+                    _boxed.push_back(std::make_shared<tree_element<T>>(v));
+            });
+            return _boxed;
+        }
+
+        virtual size_t size(void) const { return _values.size(); }
+        virtual const tree *at(size_t i) const { return children()[i].get(); }
+        virtual const std::string debug(void) const { return "tree_packed_array"; }
     };
     static inline
     auto begin(const tree_array& a) -> decltype(begin(a.children()))
@@ -117,6 +184,118 @@ namespace pson {
     std::shared_ptr<tree_pair<K, V>> make_tree_pair(const K& key, const V& value)
     { return std::make_shared<tree_pair<K, V>>(key, value); }
 
+    /* A list of fields to pull out of an object all at once, each along with
+     * where its value should go.  Scalars are stored into an option<T>, and
+     * arrays and objects into a borrowed pointer.  After extraction every
+     * field has a status, so callers can decide for themselves what's
+     * optional rather than having the lookup abort. */
+    class fields {
+    public:
+        enum class status {
+            FOUND,
+            MISSING,
+            NULL_VALUE,
+            WRONG_TYPE,
+        };
+
+    private:
+        struct request {
+            std::string key;
+            void *out;
+            bool (*store)(const tree *value, void *out);
+            enum status status;
+        };
+
+    private:
+        std::vector<request> _requests;
+        std::vector<size_t> _sorted;
+
+    public:
+        template<typename T> fields& add(const std::string& key, option<T>& out)
+        {
+            _requests.push_back(request{key, &out, &store_element<T>, status::MISSING});
+            return *this;
+        }
+
+        template<typename T> fields& add(const std::string& key, const T*& out)
+        {
+            _requests.push_back(request{key, &out, &store_node<T>, status::MISSING});
+            return *this;
+        }
+
+    public:
+        size_t size(void) const { return _requests.size(); }
+        const std::string& key(size_t i) const { return _requests[i].key; }
+        enum status status(size_t i) const { return _requests[i].status; }
+
+        /* Returns TRUE when every field was found with the right type. */
+        bool complete(void) const
+        {
+            for (const auto& r: _requests)
+                if (r.status != status::FOUND)
+                    return false;
+            return true;
+        }
+
+    private:
+        friend class tree_object;
+
+        /* Gets ready for a pass over an object: every field starts out
+         * missing, and the fields are sorted by key so each member can be
+         * matched with a binary search. */
+        void reset(void)
+        {
+            if (_sorted.size() != _requests.size()) {
+                _sorted.resize(_requests.size());
+                for (size_t i = 0; i < _sorted.size(); ++i)
+                    _sorted[i] = i;
+                std::stable_sort(_sorted.begin(), _sorted.end(),
+                                 [&](size_t a, size_t b) { return _requests[a].key < _requests[b].key; });
+            }
+
+            for (auto& r: _requests)
+                r.status = status::MISSING;
+        }
+
+        /* Hands a member to the field with the same key, if there is one.
+         * Like get(), only the first member with a given key counts. */
+        void offer(const std::string& key, const tree *value)
+        {
+            auto found = std::lower_bound(_sorted.begin(), _sorted.end(), key,
+                                          [&](size_t i, const std::string& k) { return _requests[i].key < k; });
+            for (; found != _sorted.end() && _requests[*found].key == key; ++found) {
+                auto& r = _requests[*found];
+                if (r.status != status::MISSING)
+                    continue;
+
+                if (r.store(value, r.out))
+                    r.status = status::FOUND;
+                else if (dynamic_cast<const tree_null *>(value) != nullptr)
+                    r.status = status::NULL_VALUE;
+                else
+                    r.status = status::WRONG_TYPE;
+            }
+        }
+
+        template<typename T> static bool store_element(const tree *value, void *out)
+        {
+            auto cast = dynamic_cast<const tree_element<T> *>(value);
+            if (cast == nullptr)
+                return false;
+            *static_cast<option<T> *>(out) = option<T>(cast->value());
+            return true;
+        }
+
+        template<typename T> static bool store_node(const tree *value, void *out)
+        {
+            auto cast = dynamic_cast<const T *>(value);
+            if (cast == nullptr)
+                return false;
+            *static_cast<const T **>(out) = cast;
+            return true;
+        }
+    };
+
     /* Represents a JSON object, which are just a bunch of pairs. */
     class tree_object: public tree {
     private:
@@ -138,25 +317,36 @@ namespace pson {
         : _children(vcast(children))
         {}
 
+        template<typename I>
+        tree_object(I first, I last)
+        : _children(first, last)
+        {}
+
 	virtual ~tree_object(void) {}
 
+    protected:
+        /* For subclasses that store their children some other way. */
+        tree_object(void)
+        : _children()
+        {}
+
     public:
-        const decltype(_children)& children(void) const { return _children; }
+        virtual const decltype(_children)& children(void) const { return _children; }
         virtual const std::string debug(void) const { return "tree_object"; }
 
     public:
         /* Frequently users are just expecting a string key and a simple value.
          * This function lets them get it, and in a type-safe manner! */
-        template<typename T> option<T> get(const std::string& key_value) {
-            auto child = get_pair(key_value);
+        template<typename T> option<T> get(const std::string& key_value) const {
+            auto child = find_pair(key_value);
             if (child == nullptr)
                 return option<T>();
 
-            auto value = child->value();
-            auto cast_value = std::dynamic_pointer_cast<tree_element<T>>(value);
+            auto value = child->value().get();
+            auto cast_value = dynamic_cast<const tree_element<T>*>(value);
             if (cast_value == nullptr) {
                 std::cerr << "found key " << value << " with the wrong type\n";
-                std::cerr << "  key has type " << typeid(value).name() << "\n";
+                std::cerr << "  key has type " << typeid(*value).name() << "\n";
                 std::cerr << "  looking for type " << typeid(tree_element<T>).name() << "\n";
                 abort();
             }
@@ -165,28 +355,56 @@ namespace pson {
         }
 
         /* This is a less type-safe version of the getter method. */
-        std::shared_ptr<tree_pair_t> get_pair(const std::string& key_value) {
-            for (const auto& child: _children) {
-                auto key = child->key();
+        std::shared_ptr<tree_pair_t> get_pair(const std::string& key_value) const {
+            for (const auto& child: children())
+                if (key_matches(child.get(), key_value))
+                    return child;
 
-                /* We're only looking for simple strings. */
-                auto cast_key = std::dynamic_pointer_cast<tree_element<std::string>>(key);
-                if (cast_key == nullptr)
-                    continue;
+            return nullptr;
+        }
 
-                /* Check to make sure the key matches. */
-                if (cast_key->value() != key_value)
-                    continue;
-                return child;
-            }
+        /* Borrowed versions of the lookups above, which return pointers that
+         * are valid for as long as this object is.  None of these copy a
+         * std::shared_ptr, so looking things up in a tree that's shared
+         * between threads doesn't write to any memory at all. */
+        size_t size(void) const { return children().size(); }
+        const tree_pair_t *at(size_t i) const { return children()[i].get(); }
+
+        const tree_pair_t *find_pair(const std::string& key_value) const {
+            for (const auto& child: children())
+                if (key_matches(child.get(), key_value))
+                    return child.get();
 
             return nullptr;
         }
 
+        const tree *find(const std::string& key_value) const {
+            auto child = find_pair(key_value);
+            return child == nullptr ? nullptr : child->value().get();
+        }
+
+        /* Returns nullptr both when the key is missing and when its value
+         * isn't a T, so callers can probe for a type without aborting. */
+        template<typename T> const T *find(const std::string& key_value) const
+        { return dynamic_cast<const T*>(find(key_value)); }
+
+        /* Looks up a whole list of fields in a single pass over this
+         * object, rather than one pass per field.  Returns TRUE when all of
+         * them were found with the right types. */
+        bool extract(fields& f) const {
+            f.reset();
+            for (const auto& child: children()) {
+                auto key = dynamic_cast<const tree_element<std::string>*>(child->key().get());
+                if (key != nullptr)
+                    f.offer(key->value(), child->value().get());
+            }
+            return f.complete();
+        }
+
         /* Another common operation is to match a simple string as a key to an
          * array, and then map a function over all those array elements. */
         template<typename ret_t, typename arg_t>
-        std::vector<ret_t> map(const std::string& key_value, std::function<ret_t(std::shared_ptr<arg_t>)> func) {
+        std::vector<ret_t> map(const std::string& key_value, std::function<ret_t(std::shared_ptr<arg_t>)> func) const {
             auto out = std::vector<ret_t>();
 
             auto got = get_pair(key_value);
@@ -212,6 +430,14 @@ namespace pson {
 
             return out;
         }
+
+    private:
+        /* We're only looking for simple strings as keys. */
+        static bool key_matches(const tree_pair_t *child, const std::string& key_value)
+        {
+            auto cast_key = dynamic_cast<const tree_element<std::string>*>(child->key().get());
+            return cast_key != nullptr && cast_key->value() == key_value;
+        }
     };
     static inline
     auto begin(const tree_object& a) -> decltype(begin(a.children()))
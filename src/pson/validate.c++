@@ -0,0 +1,425 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "validate.h++"
+#include "compression.h++"
+using namespace pson;
+
+/* The same states the parser keeps for each open array or object. */
+enum class validator::state: unsigned char {
+    ARRAY_FIRST,
+    ARRAY_VALUE,
+    ARRAY_COMMA,
+    OBJECT_FIRST,
+    OBJECT_KEY,
+    OBJECT_COLON,
+    OBJECT_VALUE,
+    OBJECT_COMMA,
+};
+
+/* How far along a token is to looking like something strtol() will accept:
+ * optional whitespace, an optional sign, and then at least one digit.
+ * Anything can follow the digits. */
+enum {
+    INT_LEADING,
+    INT_SIGN,
+    INT_DIGITS,
+    INT_DONE,
+    INT_INVALID,
+};
+
+static const char *validate_file(validator& v, const std::string& filename);
+
+validation pson::validate_json_string(const std::string& data)
+{
+    validator v(true);
+    v.feed(data);
+    return v.finish();
+}
+
+validation pson::validate_pson_string(const std::string& data)
+{
+    validator v(false);
+    v.feed(data);
+    return v.finish();
+}
+
+validation pson::validate_json_file(const std::string& filename)
+{
+    validator v(true);
+    auto error = validate_file(v, filename);
+    if (error != nullptr)
+        return validation{false, 0, 0, 0, error};
+    return v.finish();
+}
+
+validation pson::validate_pson_file(const std::string& filename)
+{
+    validator v(false);
+    auto error = validate_file(v, filename);
+    if (error != nullptr)
+        return validation{false, 0, 0, 0, error};
+    return v.finish();
+}
+
+validator::validator(bool json_strict, size_t max_depth)
+: _json_strict(json_strict),
+  _max_depth(max_depth),
+  _stack(),
+  _have_value(false),
+  _in_string(false),
+  _escaped(false),
+  _token_size(0),
+  _offset(0),
+  _line(1),
+  _line_start(0),
+  _error{true, 0, 0, 0, nullptr}
+{
+}
+
+void validator::feed(const char *data, size_t size)
+{
+    /* This mirrors the lexer character for character, but rather than
+     * building tokens it hands each one straight to the state machine. */
+    for (size_t i = 0; i < size && !failed(); ++i) {
+        auto c = data[i];
+        auto offset = _offset + i;
+
+        /* The contents of a string don't matter to anything, so they can
+         * be skipped over in bulk. */
+        if (_in_string && !_escaped) {
+            auto j = i;
+            while (j < size && data[j] != '"' && data[j] != '\\' && data[j] != '\n')
+                ++j;
+            if (j > i) {
+                _token_size += j - i;
+                _token_last = data[j - 1];
+                i = j - 1;
+                continue;
+            }
+        }
+
+        if (c == '\n') {
+            _line++;
+            _line_start = offset + 1;
+        }
+
+        if (_escaped) {
+            append(offset, c);
+            _escaped = false;
+            continue;
+        }
+
+        if (_in_string) {
+            switch (c) {
+            case '\\':
+                _escaped = true;
+                break;
+
+            case '"':
+                append(offset, c);
+                _in_string = false;
+                flush();
+                break;
+
+            default:
+                append(offset, c);
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '\\':
+            _escaped = true;
+            break;
+
+        case '"':
+            _in_string = true;
+            append(offset, c);
+            break;
+
+        case '[':
+        case ']':
+        case '{':
+        case '}':
+        case ',':
+        case ':':
+            flush();
+            token(here(offset), c);
+            break;
+
+        case ' ':
+        case '\t':
+        case '\n':
+            break;
+
+        default:
+            append(offset, c);
+        }
+    }
+
+    _offset += size;
+}
+
+void validator::feed_token(const char *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        append(_offset, data[i]);
+    flush();
+    _offset++;
+}
+
+validation validator::finish(void)
+{
+    flush();
+
+    if (_stack.size() > 0)
+        fail(here(_offset), "Unterminated array or object");
+    else if (!_have_value)
+        fail(here(_offset), "No value");
+
+    return _error;
+}
+
+void validator::append(size_t offset, char c)
+{
+    if (_token_size == 0) {
+        _token_where = here(offset);
+        _token_first = c;
+        _token_null = true;
+        _token_int = INT_LEADING;
+        _token_negative = false;
+        _token_value = 0;
+    }
+
+    _token_null = _token_null && _token_size < 4 && c == "null"[_token_size];
+    _token_size++;
+    _token_last = c;
+
+    auto digit = (c >= '0' && c <= '9');
+    switch (_token_int) {
+    case INT_LEADING:
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r')
+            break;
+        if (c == '+' || c == '-') {
+            _token_negative = (c == '-');
+            _token_int = INT_SIGN;
+            break;
+        }
+        /* fall through */
+    case INT_SIGN:
+    case INT_DIGITS:
+        if (digit) {
+            _token_int = INT_DIGITS;
+            /* Once the value is out of range there's no point in keeping
+             * track of exactly how far out it is. */
+            if (_token_value < (1ULL << 40))
+                _token_value = _token_value * 10 + (c - '0');
+        } else {
+            _token_int = (_token_int == INT_DIGITS) ? INT_DONE : INT_INVALID;
+        }
+        break;
+    }
+}
+
+void validator::flush(void)
+{
+    if (_token_size == 0 || failed())
+        return;
+
+    const auto& w = _token_where;
+    auto size = _token_size;
+    _token_size = 0;
+
+    /* The parser decides what a token is by looking at it in this order. */
+    if (size == 1 && (_token_first == '[' || _token_first == ']' ||
+                      _token_first == '{' || _token_first == '}' ||
+                      _token_first == ',' || _token_first == ':')) {
+        token(w, _token_first);
+    } else if (_token_first == '"') {
+        if (size < 2 || _token_last != '"')
+            fail(w, "Malformed string: no trailing \"");
+        else
+            token(w, 0);
+    } else if (_token_null && size == 4) {
+        token(w, 0);
+    } else if ((_token_int == INT_DIGITS || _token_int == INT_DONE) &&
+               _token_value <= (_token_negative ? 2147483648ULL : 2147483647ULL)) {
+        token(w, 0);
+    } else {
+        fail(w, "Unparsable token");
+    }
+}
+
+/* Punctuation shows up as itself, and every other sort of token as 0. */
+void validator::token(const where& w, char c)
+{
+    if (failed())
+        return;
+
+    if (_stack.size() == 0) {
+        if (!_have_value)
+            value(w, c);
+        else if (!_json_strict && c == ',')
+            {}
+        else
+            fail(w, "Extra token after the end of the document");
+        return;
+    }
+
+    auto& top = _stack.back();
+    switch (top) {
+    case state::ARRAY_FIRST:
+    case state::OBJECT_FIRST:
+        if (c == ']' || c == '}')
+            close(w, c);
+        else
+            value(w, c);
+        break;
+
+    case state::ARRAY_VALUE:
+    case state::OBJECT_KEY:
+        if (c == ']' || c == '}')
+            close(w, c);
+        else if (c != ',')
+            value(w, c);
+        break;
+
+    case state::OBJECT_VALUE:
+        value(w, c);
+        break;
+
+    case state::ARRAY_COMMA:
+    case state::OBJECT_COMMA:
+        if (c == ',')
+            top = (top == state::ARRAY_COMMA) ? state::ARRAY_VALUE : state::OBJECT_KEY;
+        else if (c == ']' || c == '}')
+            close(w, c);
+        else
+            fail(w, "Missing comma");
+        break;
+
+    case state::OBJECT_COLON:
+        if (c == ':')
+            top = state::OBJECT_VALUE;
+        else
+            fail(w, "Missing : after object key");
+        break;
+    }
+}
+
+void validator::value(const where& w, char c)
+{
+    switch (c) {
+    case '[':
+    case '{':
+        if (_stack.size() >= _max_depth)
+            fail(w, "Exceeded maximum nesting depth");
+        else
+            _stack.push_back((c == '[') ? state::ARRAY_FIRST : state::OBJECT_FIRST);
+        break;
+
+    case 0:
+        deliver();
+        break;
+
+    default:
+        fail(w, "Unparsable token");
+    }
+}
+
+void validator::close(const where& w, char c)
+{
+    switch (_stack.back()) {
+    case state::ARRAY_FIRST:
+    case state::ARRAY_VALUE:
+    case state::ARRAY_COMMA:
+        if (c != ']')
+            return fail(w, "Arrays must end with ]");
+        break;
+
+    case state::OBJECT_FIRST:
+    case state::OBJECT_KEY:
+    case state::OBJECT_COMMA:
+        if (c != '}')
+            return fail(w, "Objects must end with }");
+        break;
+
+    case state::OBJECT_COLON:
+    case state::OBJECT_VALUE:
+        return fail(w, "Object key without value");
+    }
+
+    _stack.pop_back();
+    deliver();
+}
+
+void validator::deliver(void)
+{
+    if (_stack.size() == 0) {
+        _have_value = true;
+        return;
+    }
+
+    auto& top = _stack.back();
+    switch (top) {
+    case state::ARRAY_FIRST:
+    case state::ARRAY_VALUE:
+        top = state::ARRAY_COMMA;
+        break;
+
+    case state::OBJECT_FIRST:
+    case state::OBJECT_KEY:
+        top = state::OBJECT_COLON;
+        break;
+
+    case state::OBJECT_VALUE:
+        top = state::OBJECT_COMMA;
+        break;
+
+    case state::ARRAY_COMMA:
+    case state::OBJECT_COLON:
+    case state::OBJECT_COMMA:
+        break;
+    }
+}
+
+void validator::fail(const where& w, const char *message)
+{
+    if (failed())
+        return;
+
+    _error = validation{false, w.offset, w.line, w.column, message};
+}
+
+const char *validate_file(validator& v, const std::string& filename)
+{
+    compressed_ifstream file(filename);
+    if (!file)
+        return "Unable to open file";
+
+    std::vector<char> buffer(1 << 16);
+    while (file && !v.failed()) {
+        file.read(buffer.data(), buffer.size());
+        v.feed(buffer.data(), file.gcount());
+    }
+    if (file.bad() && !v.failed())
+        return "Damaged compressed data";
+    return nullptr;
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__VALIDATE_HXX
+#define LIBPSON__VALIDATE_HXX
+
+#include "parser.h++"
+#include <string>
+#include <vector>
+
+namespace pson {
+    /* The outcome of checking a document, which points at the first thing
+     * that's wrong with it.  Lines and columns both count from 1. */
+    struct validation {
+        bool valid;
+        size_t offset;
+        size_t line;
+        size_t column;
+
+        /* Describes what's wrong, or nullptr for a valid document. */
+        const char *message;
+
+        explicit operator bool(void) const { return valid; }
+    };
+
+    /* Answers "would this parse?" without building anything: it accepts
+     * exactly what the parser does, but never stores a token or allocates a
+     * node, and never aborts.  The only memory used is one entry per level
+     * of nesting.  Input is fed in as pieces, which can be split anywhere,
+     * and the answer comes out of finish(). */
+    class validator {
+    private:
+        enum class state: unsigned char;
+
+        struct where {
+            size_t offset;
+            size_t line;
+            size_t column;
+        };
+
+    private:
+        const bool _json_strict;
+        const size_t _max_depth;
+        std::vector<state> _stack;
+        bool _have_value;
+
+        /* The lexer's state, which is either in the body or in a string,
+         * possibly right after a backslash. */
+        bool _in_string;
+        bool _escaped;
+
+        /* What's known about the token that's being built: just enough to
+         * tell whether the parser would accept it. */
+        size_t _token_size;
+        where _token_where;
+        char _token_first;
+        char _token_last;
+        bool _token_null;
+        unsigned char _token_int;
+        bool _token_negative;
+        unsigned long long _token_value;
+
+        size_t _offset;
+        size_t _line;
+        size_t _line_start;
+        validation _error;
+
+    public:
+        validator(bool json_strict = false,
+                  size_t max_depth = parse_context::default_max_depth);
+
+    public:
+        void feed(const char *data, size_t size);
+        void feed(const std::string& data) { feed(data.data(), data.size()); }
+
+        /* Checks a token that's already been lexed, for callers that do
+         * their own lexing and want to know whether the parser would take
+         * their tokens before handing them over.  Tokens and characters
+         * can't be mixed in one validator, and offsets count tokens rather
+         * than characters. */
+        void feed_token(const char *data, size_t size);
+
+        validation finish(void);
+
+        /* Returns TRUE once something wrong has been found, after which
+         * there's no reason to keep feeding it. */
+        bool failed(void) const { return _error.message != nullptr; }
+
+    private:
+        where here(size_t offset) const
+        { return where{offset, _line, offset - _line_start + 1}; }
+
+        inline void append(size_t offset, char c);
+        inline void flush(void);
+        void token(const where& w, char c);
+        void value(const where& w, char c);
+        void close(const where& w, char c);
+        void deliver(void);
+        void fail(const where& w, const char *message);
+    };
+
+    validation validate_json_string(const std::string& data);
+    validation validate_pson_string(const std::string& data);
+    validation validate_json_file(const std::string& filename);
+    validation validate_pson_file(const std::string& filename);
+}
+
+#endif
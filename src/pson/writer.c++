@@ -0,0 +1,275 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "writer.h++"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+using namespace pson;
+
+writer::writer(enum format format)
+: _out(),
+  _format(format),
+  _stack(),
+  _have_key(false),
+  _done(false)
+{
+}
+
+void writer::clear(void)
+{
+    _out.clear();
+    _stack.clear();
+    _have_key = false;
+    _done = false;
+}
+
+writer& writer::begin_object(void)
+{
+    before_value();
+    raw("{");
+    _stack.push_back(frame{scope::OBJECT, 0});
+    return *this;
+}
+
+writer& writer::end_object(void)
+{
+    end_scope(scope::OBJECT);
+    return *this;
+}
+
+writer& writer::begin_array(void)
+{
+    before_value();
+    raw("[");
+    _stack.push_back(frame{scope::ARRAY, 0});
+    return *this;
+}
+
+writer& writer::end_array(void)
+{
+    end_scope(scope::ARRAY);
+    return *this;
+}
+
+writer& writer::key(const std::string& key)
+{
+    before_key();
+    quote(key);
+    raw(_format == format::PRETTY ? ": " : ":");
+    _have_key = true;
+    return *this;
+}
+
+writer& writer::value(const std::string& value)
+{
+    before_value();
+    quote(value);
+    after_value();
+    return *this;
+}
+
+writer& writer::value(const char *value)
+{
+    return this->value(std::string(value));
+}
+
+writer& writer::value(int value)
+{
+    return scalar(std::to_string(value));
+}
+
+writer& writer::value(long value)
+{
+    return scalar(std::to_string(value));
+}
+
+writer& writer::value(long long value)
+{
+    return scalar(std::to_string(value));
+}
+
+writer& writer::value(unsigned value)
+{
+    return scalar(std::to_string(value));
+}
+
+writer& writer::value(unsigned long value)
+{
+    return scalar(std::to_string(value));
+}
+
+writer& writer::value(unsigned long long value)
+{
+    return scalar(std::to_string(value));
+}
+
+writer& writer::value(double value)
+{
+    /* JSON has no way to represent infinities or NaNs, so the closest we
+     * can do is null. */
+    if (!std::isfinite(value))
+        return null();
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", value);
+    return scalar(buffer);
+}
+
+writer& writer::value(bool value)
+{
+    return scalar(value ? "true" : "false");
+}
+
+writer& writer::null(void)
+{
+    return scalar("null");
+}
+
+void writer::before_value(void)
+{
+    if (_done) {
+        std::cerr << "Attempted to write a second top-level JSON value\n";
+        abort();
+    }
+
+    if (_stack.size() == 0)
+        return;
+
+    auto& top = _stack.back();
+    switch (top.scope) {
+    case scope::OBJECT:
+        if (_have_key == false) {
+            std::cerr << "Attempted to write an object value without a key\n";
+            abort();
+        }
+        _have_key = false;
+        break;
+
+    case scope::ARRAY:
+        if (top.count > 0)
+            raw(",");
+        if (_format == format::PRETTY) {
+            raw("\n");
+            indent(_stack.size());
+        }
+        top.count++;
+        break;
+    }
+}
+
+void writer::after_value(void)
+{
+    /* A top-level scalar is the whole document, while a top-level object
+     * or array is finished by end_scope(). */
+    if (_stack.size() == 0)
+        _done = true;
+}
+
+void writer::before_key(void)
+{
+    if (_stack.size() == 0 || _stack.back().scope != scope::OBJECT) {
+        std::cerr << "Attempted to write a key outside of an object\n";
+        abort();
+    }
+
+    if (_have_key == true) {
+        std::cerr << "Attempted to write two keys in a row\n";
+        abort();
+    }
+
+    auto& top = _stack.back();
+    if (top.count > 0)
+        raw(",");
+    if (_format == format::PRETTY) {
+        raw("\n");
+        indent(_stack.size());
+    }
+    top.count++;
+}
+
+void writer::end_scope(enum scope scope)
+{
+    if (_stack.size() == 0 || _stack.back().scope != scope) {
+        std::cerr << "Mismatched end of JSON "
+                  << (scope == scope::OBJECT ? "object" : "array")
+                  << "\n";
+        abort();
+    }
+
+    if (_have_key == true) {
+        std::cerr << "Object ended with a key but no value\n";
+        abort();
+    }
+
+    auto count = _stack.back().count;
+    _stack.pop_back();
+
+    if (count > 0 && _format == format::PRETTY) {
+        raw("\n");
+        indent(_stack.size());
+    }
+    raw(scope == scope::OBJECT ? "}" : "]");
+    after_value();
+}
+
+writer& writer::scalar(const std::string& text)
+{
+    before_value();
+    raw(text);
+    after_value();
+    return *this;
+}
+
+void writer::indent(size_t depth)
+{
+    _out.append(depth * 2, ' ');
+}
+
+void writer::raw(const std::string& text)
+{
+    _out.append(text);
+}
+
+void writer::quote(const std::string& text)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    _out.push_back('"');
+    for (const auto& c: text) {
+        switch (c) {
+        case '"':  _out.append("\\\""); break;
+        case '\\': _out.append("\\\\"); break;
+        case '\b': _out.append("\\b");  break;
+        case '\f': _out.append("\\f");  break;
+        case '\n': _out.append("\\n");  break;
+        case '\r': _out.append("\\r");  break;
+        case '\t': _out.append("\\t");  break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                _out.append("\\u00");
+                _out.push_back(hex[(c >> 4) & 0xF]);
+                _out.push_back(hex[c & 0xF]);
+            } else {
+                _out.push_back(c);
+            }
+        }
+    }
+    _out.push_back('"');
+}
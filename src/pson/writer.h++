@@ -0,0 +1,161 @@
+/*
+ * This file is part of pson: Palmer's JSON Parsing Library
+ * Copyright (C) 2016 Palmer Dabbelt <palmer@dabelt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef LIBPSON__WRITER_HXX
+#define LIBPSON__WRITER_HXX
+
+#include "option.h++"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pson {
+    class writer;
+
+    /* Users teach the writer about their own types by specializing this
+     * template, providing a
+     *   static void write(writer& w, const T& value);
+     * that calls back into the writer. */
+    template<typename T> struct serializer;
+
+    /* Streams JSON text straight into a buffer, without building a tree
+     * first.  The writer keeps track of where commas go, so the output
+     * never has a trailing comma no matter what order things get written
+     * in. */
+    class writer {
+    public:
+        enum class format {
+            PRETTY,
+            COMPACT,
+        };
+
+    private:
+        enum class scope {
+            ARRAY,
+            OBJECT,
+        };
+
+        struct frame {
+            enum scope scope;
+            size_t count;
+        };
+
+    private:
+        std::string _out;
+        const enum format _format;
+        std::vector<frame> _stack;
+        bool _have_key;
+        bool _done;
+
+    public:
+        writer(enum format format = format::PRETTY);
+
+    public:
+        /* The JSON text that's been written so far. */
+        const std::string& str(void) const { return _out; }
+
+        /* Throws away everything that's been written but keeps the buffer
+         * around, so a single writer can be reused for many documents. */
+        void clear(void);
+
+        /* Returns TRUE when a single complete JSON value has been
+         * written. */
+        bool complete(void) const { return _done; }
+
+    public:
+        writer& begin_object(void);
+        writer& end_object(void);
+        writer& begin_array(void);
+        writer& end_array(void);
+        writer& key(const std::string& key);
+
+        writer& value(const std::string& value);
+        writer& value(const char *value);
+        writer& value(int value);
+        writer& value(long value);
+        writer& value(long long value);
+        writer& value(unsigned value);
+        writer& value(unsigned long value);
+        writer& value(unsigned long long value);
+        writer& value(double value);
+        writer& value(bool value);
+        writer& null(void);
+
+        /* Writes anything there's a serializer for. */
+        template<typename T> writer& write(const T& value)
+        {
+            serializer<T>::write(*this, value);
+            return *this;
+        }
+
+        /* The common case when writing out a struct is a string key
+         * followed directly by its value. */
+        template<typename T> writer& field(const std::string& k, const T& v)
+        {
+            key(k);
+            return write(v);
+        }
+
+    private:
+        /* Called before every value (or key) to emit the separator and
+         * indentation that goes in front of it. */
+        void before_value(void);
+        void after_value(void);
+        void before_key(void);
+        void end_scope(enum scope scope);
+        writer& scalar(const std::string& text);
+        void indent(size_t depth);
+        void raw(const std::string& text);
+        void quote(const std::string& text);
+    };
+
+    /* Serializers for the types JSON knows about natively. */
+    template<typename T> struct serializer {
+        static void write(writer& w, const T& value) { w.value(value); }
+    };
+
+    template<typename T> struct serializer<std::vector<T>> {
+        static void write(writer& w, const std::vector<T>& value) {
+            w.begin_array();
+            for (const auto& v: value)
+                w.write(v);
+            w.end_array();
+        }
+    };
+
+    template<typename T> struct serializer<std::map<std::string, T>> {
+        static void write(writer& w, const std::map<std::string, T>& value) {
+            w.begin_object();
+            for (const auto& v: value)
+                w.field(v.first, v.second);
+            w.end_object();
+        }
+    };
+
+    template<typename T> struct serializer<option<T>> {
+        static void write(writer& w, const option<T>& value) {
+            if (value.valid())
+                w.write(value.data());
+            else
+                w.null();
+        }
+    };
+}
+
+#endif
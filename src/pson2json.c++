@@ -18,8 +18,16 @@
  */
 
 #include <pson/parser.h++>
+#include <pson/canonical.h++>
 #include <pson/emitter.h++>
+#include <pson/merge.h++>
+#include <pson/mutable_document.h++>
+#include <pson/record_file.h++>
+#include <pson/transcoder.h++>
+#include <pson/validate.h++>
 #include <tclap/CmdLine.h>
+#include <cinttypes>
+#include <cstdio>
 #include "version.h"
 
 int main(int argc, const char **argv)
@@ -32,7 +40,7 @@ int main(int argc, const char **argv)
 
         TCLAP::ValueArg<std::string> input("i",
                                            "input",
-                                           "A PSON-formatted file",
+                                           "A PSON-formatted file, which may be gzip-compressed",
                                            true,
                                            "",
                                            "in.pson");
@@ -41,15 +49,175 @@ int main(int argc, const char **argv)
         TCLAP::ValueArg<std::string> output("o",
                                             "output",
                                             "A JSON-formatted file",
-                                            true,
+                                            false,
                                             "",
                                             "out.json");
         cmd.add(output);
 
+        TCLAP::SwitchArg stats("",
+                               "stats",
+                               "Print timings and counters to stderr",
+                               false);
+        cmd.add(stats);
+
+        TCLAP::SwitchArg check("",
+                               "check",
+                               "Only check that the input is valid PSON",
+                               false);
+        cmd.add(check);
+
+        TCLAP::SwitchArg stream("",
+                                "stream",
+                                "Convert token by token, without building a tree",
+                                false);
+        cmd.add(stream);
+
+        TCLAP::SwitchArg compact("",
+                                 "compact",
+                                 "Write JSON without any whitespace (implies --stream)",
+                                 false);
+        cmd.add(compact);
+
+        TCLAP::SwitchArg canonical("",
+                                   "canonical",
+                                   "Write canonical JSON: sorted keys and no whitespace",
+                                   false);
+        cmd.add(canonical);
+
+        TCLAP::SwitchArg hash("",
+                              "hash",
+                              "Print a hash of the input's structure to stdout",
+                              false);
+        cmd.add(hash);
+
+        TCLAP::SwitchArg gzip("",
+                              "gzip",
+                              "Compress the output with gzip",
+                              false);
+        cmd.add(gzip);
+
+        TCLAP::ValueArg<long> record("",
+                                     "record",
+                                     "Only convert the Nth value (counting from 0) of an input with many of them, like NDJSON",
+                                     false,
+                                     -1,
+                                     "N");
+        cmd.add(record);
+
+        TCLAP::MultiArg<std::string> overlay("",
+                                             "overlay",
+                                             "Deep-merge another PSON file over the input (can be given many times, later ones win)",
+                                             false,
+                                             "layer.pson");
+        cmd.add(overlay);
+
+        TCLAP::ValueArg<std::string> patch("",
+                                           "patch",
+                                           "Apply a JSON Patch (RFC 6902) to the input, after any overlays",
+                                           false,
+                                           "",
+                                           "patch.json");
+        cmd.add(patch);
+
         cmd.parse(argc, argv);
 
-        auto t = pson::parse_pson_file(input.getValue());
-        pson::emit_json(output.getValue(), t);
+        auto whole_input = (record.getValue() < 0 && overlay.getValue().size() == 0 && patch.getValue() == "");
+        if (!whole_input && (check.getValue() || stream.getValue() || compact.getValue() || stats.getValue())) {
+            std::cerr << "error: --record, --overlay and --patch can't be used with --check, --stream, --compact, or --stats\n";
+            return 2;
+        }
+
+        auto compress = gzip.getValue() ? pson::compression::GZIP : pson::compression::NONE;
+
+        /* Either the whole input or just one record of it, with any
+         * overlays merged on top and then the patch applied. */
+        auto load = [&]() {
+            std::shared_ptr<pson::tree> t = nullptr;
+            if (record.getValue() < 0) {
+                t = pson::parse_pson_file(input.getValue());
+            } else {
+                pson::record_file f(input.getValue());
+                if ((size_t)record.getValue() >= f.size()) {
+                    std::cerr << input.getValue() << " has only " << f.size() << " records\n";
+                    return t;
+                }
+                t = f.parse(record.getValue());
+            }
+
+            for (const auto& filename: overlay.getValue()) {
+                auto layer = pson::parse_pson_file(filename);
+                if (t == nullptr || layer == nullptr)
+                    return std::shared_ptr<pson::tree>(nullptr);
+                t = pson::merge(t, layer);
+            }
+
+            if (t != nullptr && patch.getValue() != "") {
+                auto p = pson::parse_pson_file(patch.getValue());
+                if (p == nullptr)
+                    return std::shared_ptr<pson::tree>(nullptr);
+                pson::mutable_document d(t);
+                if (!d.apply_patch(p))
+                    return std::shared_ptr<pson::tree>(nullptr);
+                t = d.root();
+            }
+            return t;
+        };
+
+        if (check.getValue() == true) {
+            auto v = pson::validate_pson_file(input.getValue());
+            if (v.valid)
+                return 0;
+            std::cerr << input.getValue() << ":"
+                      << v.line << ":"
+                      << v.column << ": "
+                      << v.message << "\n";
+            return 1;
+        }
+
+        if (hash.getValue() == true) {
+            auto t = load();
+            if (t == nullptr)
+                return 1;
+            printf("%016" PRIx64 "\n", pson::structural_hash(t));
+            return 0;
+        }
+
+        if (output.getValue() == "") {
+            std::cerr << "error: --output is required unless --check or --hash is given\n";
+            return 2;
+        }
+
+        if (canonical.getValue() == true) {
+            auto t = load();
+            if (t == nullptr)
+                return 1;
+            pson::emit_canonical_json(output.getValue(), t, compress);
+            return 0;
+        }
+
+        if (stream.getValue() == true || compact.getValue() == true) {
+            auto format = compact.getValue() ? pson::writer::format::COMPACT
+                                             : pson::writer::format::PRETTY;
+            return pson::transcode_pson_file(input.getValue(), output.getValue(), format, compress) ? 0 : 1;
+        }
+
+        if (stats.getValue() == false) {
+            auto t = load();
+            if (t == nullptr)
+                return 1;
+            pson::emit_json(output.getValue(), t, compress);
+            return 0;
+        }
+
+        pson::stats s;
+        auto t = pson::parse_pson_file(input.getValue(), s);
+        if (t == nullptr)
+            return 1;
+        pson::emit_json(output.getValue(), t, s, compress);
+
+        pson::writer w;
+        w.write(s);
+        std::cerr << w.str() << "\n";
         return 0;
     } catch (TCLAP::ArgException &e) {
         std::cerr << "error: "
@@ -0,0 +1,9 @@
+#include "_tempdir.bash"
+
+# This one has to abort, and say why.
+if $PTEST_BINARY map_parallel_wrong_type 2>stderr
+then
+    exit 1
+fi
+cat stderr
+grep -q "found child, but not of argument type" stderr
@@ -0,0 +1,3 @@
+#include "_tempdir.bash"
+
+$PTEST_BINARY patch_rollback
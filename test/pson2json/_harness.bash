@@ -4,3 +4,7 @@ cat $OUTPUT
 
 cat $OUTPUT.gold
 diff -u $OUTPUT $OUTPUT.gold
+
+# The streaming converter has to produce exactly the same output.
+$PTEST_BINARY --input $INPUT --output $OUTPUT.stream --stream
+diff -u $OUTPUT.stream $OUTPUT.gold
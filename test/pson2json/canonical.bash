@@ -0,0 +1,20 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "zebra": [3, 2, 1,],
+  "apple": {
+    "b": "with a \" quote",
+    "a": null,
+  },
+  "mango": 007,
+}
+EOF
+
+cat >$OUTPUT.gold <<"EOF"
+{"apple":{"a":null,"b":"with a \" quote"},"mango":7,"zebra":[3,2,1]}
+EOF
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT --canonical
+cat $OUTPUT
+diff -u $OUTPUT $OUTPUT.gold
@@ -0,0 +1,15 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "a": [1, 2, 3,],
+  "b" "missing a colon",
+}
+EOF
+
+if $PTEST_BINARY --input $INPUT --check 2>check.err
+then
+    exit 1
+fi
+cat check.err
+grep "in.pson:3:7: Missing : after object key" check.err
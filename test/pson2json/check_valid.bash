@@ -0,0 +1,11 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "a": [1, 2, 3,],
+  "b": "with a \" quote",
+}
+EOF
+
+$PTEST_BINARY --input $INPUT --check
+test ! -e $OUTPUT
@@ -0,0 +1,19 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "a": [1, 2, [],],
+  "b": {
+    "c": null,,
+  },
+  "d": {},
+}
+EOF
+
+cat >$OUTPUT.gold <<"EOF"
+{"a":[1,2,[]],"b":{"c":null},"d":{}}
+EOF
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT --compact
+cat $OUTPUT
+diff -u $OUTPUT $OUTPUT.gold
@@ -0,0 +1,45 @@
+#include "_tempdir.bash"
+
+cat >plain.pson <<"EOF"
+{
+  "a": [1, 2, 3,],
+  "b": "compressed",
+}
+EOF
+gzip -c plain.pson > $INPUT
+
+cat >$OUTPUT.gold <<"EOF"
+{
+  "a": [
+    1,
+    2,
+    3
+  ],
+  "b": "compressed"
+}
+EOF
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT
+cat $OUTPUT
+diff -u $OUTPUT $OUTPUT.gold
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT.stream --stream
+diff -u $OUTPUT.stream $OUTPUT.gold
+
+$PTEST_BINARY --input $INPUT --check
+
+# Compressed output, from both the tree and the streaming converter.
+$PTEST_BINARY --input plain.pson --output out.json.gz --gzip
+gzip -dc out.json.gz > out.json.gunzip
+diff -u out.json.gunzip $OUTPUT.gold
+
+$PTEST_BINARY --input plain.pson --output stream.json.gz --stream --gzip
+gzip -dc stream.json.gz > stream.json.gunzip
+diff -u stream.json.gunzip $OUTPUT.gold
+
+# A truncated file has to be rejected, not parsed as far as it goes.
+head -c 20 $INPUT > truncated.pson
+if $PTEST_BINARY --input truncated.pson --output truncated.json
+then
+    exit 1
+fi
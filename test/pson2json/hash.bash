@@ -0,0 +1,27 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "a": [1, 2, {"x": null, "y": "z"}],
+  "b": "c",
+}
+EOF
+
+cat >reordered.pson <<"EOF"
+{"b": "c", "a": [1, 2, {"y": "z", "x": null,},],}
+EOF
+
+cat >changed.pson <<"EOF"
+{"b": "c", "a": [2, 1, {"y": "z", "x": null}]}
+EOF
+
+$PTEST_BINARY --input $INPUT --hash > hash.txt
+$PTEST_BINARY --input reordered.pson --hash > reordered.txt
+$PTEST_BINARY --input changed.pson --hash > changed.txt
+cat hash.txt reordered.txt changed.txt
+
+diff -u hash.txt reordered.txt
+if diff -u hash.txt changed.txt
+then
+    exit 1
+fi
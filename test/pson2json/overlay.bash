@@ -0,0 +1,48 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "name": "service",
+  "limits": {"cpu": 2, "memory": 512, "disk": 10,},
+  "hosts": ["a", "b"],
+  "debug": null,
+}
+EOF
+
+cat >region.pson <<"EOF"
+{
+  "limits": {"memory": 1024, "network": {"mbps": 100}},
+  "hosts": ["c"],
+}
+EOF
+
+cat >host.pson <<"EOF"
+{
+  "limits": {"cpu": 4, "network": {"burst": 200}},
+  "debug": 1,
+  "limits": "ignored, only the first limits counts",
+}
+EOF
+
+cat >$OUTPUT.gold <<"EOF"
+{
+  "name": "service",
+  "limits": {
+    "cpu": 4,
+    "memory": 1024,
+    "disk": 10,
+    "network": {
+      "mbps": 100,
+      "burst": 200
+    }
+  },
+  "hosts": [
+    "c"
+  ],
+  "debug": 1
+}
+EOF
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT --overlay region.pson --overlay host.pson
+cat $OUTPUT
+diff -u $OUTPUT $OUTPUT.gold
@@ -0,0 +1,80 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "ints": [-20, -13, -6, 1, 8, 15, 22, 29, 36, 43, 50, 57, 64, 71, 78, 85, 92, 99, 106, 113,],
+  "strings": ["s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "s12", "s13", "s14", "s15", "s16"],
+  "mixed": [-20, -13, -6, 1, 8, 15, 22, 29, 36, 43, 50, 57, 64, 71, 78, 85, 92, 99, 106, 113, "x"],
+}
+EOF
+
+cat >$OUTPUT.gold <<"EOF"
+{
+  "ints": [
+    -20,
+    -13,
+    -6,
+    1,
+    8,
+    15,
+    22,
+    29,
+    36,
+    43,
+    50,
+    57,
+    64,
+    71,
+    78,
+    85,
+    92,
+    99,
+    106,
+    113
+  ],
+  "strings": [
+    "s0",
+    "s1",
+    "s2",
+    "s3",
+    "s4",
+    "s5",
+    "s6",
+    "s7",
+    "s8",
+    "s9",
+    "s10",
+    "s11",
+    "s12",
+    "s13",
+    "s14",
+    "s15",
+    "s16"
+  ],
+  "mixed": [
+    -20,
+    -13,
+    -6,
+    1,
+    8,
+    15,
+    22,
+    29,
+    36,
+    43,
+    50,
+    57,
+    64,
+    71,
+    78,
+    85,
+    92,
+    99,
+    106,
+    113,
+    "x"
+  ]
+}
+EOF
+
+#include "_harness.bash"
@@ -0,0 +1,69 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{
+  "name": "service",
+  "limits": {"cpu": 2, "memory": 512,},
+  "hosts": ["a", "b", "c"],
+  "a/b": {"m~n": 1},
+}
+EOF
+
+cat >patch.json <<"EOF"
+[
+  {"op": "test", "path": "/limits/cpu", "value": 2},
+  {"op": "replace", "path": "/limits/cpu", "value": 4},
+  {"op": "add", "path": "/limits/network", "value": {"mbps": 100}},
+  {"op": "remove", "path": "/limits/memory"},
+  {"op": "add", "path": "/hosts/1", "value": "inserted"},
+  {"op": "add", "path": "/hosts/-", "value": "last"},
+  {"op": "move", "path": "/hosts/0", "from": "/hosts/3"},
+  {"op": "copy", "path": "/backup", "from": "/limits"},
+  {"op": "replace", "path": "/a~1b/m~0n", "value": 2}
+]
+EOF
+
+cat >$OUTPUT.gold <<"EOF"
+{
+  "name": "service",
+  "limits": {
+    "cpu": 4,
+    "network": {
+      "mbps": 100
+    }
+  },
+  "hosts": [
+    "c",
+    "a",
+    "inserted",
+    "b",
+    "last"
+  ],
+  "a/b": {
+    "m~n": 2
+  },
+  "backup": {
+    "cpu": 4,
+    "network": {
+      "mbps": 100
+    }
+  }
+}
+EOF
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT --patch patch.json
+cat $OUTPUT
+diff -u $OUTPUT $OUTPUT.gold
+
+# A patch either applies completely or not at all.
+cat >failing.json <<"EOF"
+[
+  {"op": "replace", "path": "/name", "value": "changed"},
+  {"op": "test", "path": "/limits/cpu", "value": 3}
+]
+EOF
+
+if $PTEST_BINARY --input $INPUT --output failing.out --patch failing.json
+then
+    exit 1
+fi
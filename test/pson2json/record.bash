@@ -0,0 +1,57 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+{"id": 0, "note": "a } and a [ in a string"}
+{"id": 1, "tags": ["x", "y",],}
+{
+  "id": 2,
+  "nested": {"a": [1, 2]},
+},
+"just a string"
+EOF
+
+cat >$OUTPUT.gold <<"EOF"
+{
+  "id": 2,
+  "nested": {
+    "a": [
+      1,
+      2
+    ]
+  }
+}
+EOF
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT --record 2
+cat $OUTPUT
+diff -u $OUTPUT $OUTPUT.gold
+
+echo '"just a string"' > string.gold
+$PTEST_BINARY --input $INPUT --output string.json --record 3
+diff -u string.json string.gold
+
+if $PTEST_BINARY --input $INPUT --output missing.json --record 4
+then
+    exit 1
+fi
+
+# A scalar at the very end, with no separator after it, is a record too.
+printf '{"a": 1}\n{"a": 2}\n3' > scalar.ndjson
+echo '3' > scalar.gold
+$PTEST_BINARY --input scalar.ndjson --output scalar.json --record 2
+diff -u scalar.json scalar.gold
+
+# A malformed record fails on its own, without taking the process down
+# and without getting in the way of the records around it.
+printf '{"a": 1}\n{"a":}\n{"a": 3}\n' > malformed.ndjson
+if $PTEST_BINARY --input malformed.ndjson --output malformed.json --record 1
+then
+    exit 1
+else
+    test $? -lt 128
+fi
+echo '{
+  "a": 3
+}' > malformed.gold
+$PTEST_BINARY --input malformed.ndjson --output malformed.json --record 2
+diff -u malformed.json malformed.gold
@@ -0,0 +1,29 @@
+#include "_tempdir.bash"
+
+cat >$INPUT <<"EOF"
+[
+  1,
+  2,
+  [
+    3,
+  ],
+]
+EOF
+
+cat >$OUTPUT.gold <<"EOF"
+[
+  1,
+  2,
+  [
+    3
+  ]
+]
+EOF
+
+$PTEST_BINARY --input $INPUT --output $OUTPUT --stats 2>stats.json
+cat stats.json
+grep '"tokens": 11' stats.json
+grep '"nodes": 5' stats.json
+grep '"peak_depth": 2' stats.json
+
+diff -u $OUTPUT $OUTPUT.gold
@@ -0,0 +1,13 @@
+#include "_tempdir.bash"
+
+# Nesting deeper than the parser's limit is rejected with an error, rather
+# than running the parser out of stack.
+for i in $(seq 1 5000); do printf '['; done >$INPUT
+for i in $(seq 1 5000); do printf ']'; done >>$INPUT
+
+if $PTEST_BINARY --input $INPUT --output $OUTPUT 2>err.txt
+then
+    exit 1
+fi
+
+grep "maximum nesting depth" err.txt